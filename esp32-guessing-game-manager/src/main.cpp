@@ -7,10 +7,21 @@ Made by Valérian Grégoire--Bégranger -- 2025
 #include <Arduino.h>
 #include <WiFi.h>
 #include <esp_now.h>
-
-// Game Manager MAC address: 30:C9:22:FF:71:AC
-// Remote MAC address: 30:C9:22:FF:81:D0
-uint8_t remoteMacAddress[6] = {0x30, 0xC9, 0x22, 0xFF, 0x81, 0xD0};
+#include <BinLog.h>
+#include <ButtonDebouncer.h>
+#include <CpuBoost.h>
+#include <EspNowLink.h>
+#include <EventLoop.h>
+#include <GameHistory.h>
+#include <GuessProtocol.h>
+#include <InputRecorder.h>
+#include <LedAnimator.h>
+#include <NvsCache.h>
+#include <PackedSequence.h>
+#include <PeerTable.h>
+#include <Retransmitter.h>
+#include <SequenceRandom.h>
+#include <SpscQueue.h>
 
 // Game states
 enum class States
@@ -21,50 +32,156 @@ enum class States
     game_over
 };
 States state;
+States previousState;
+
+// Events waking up loop()
+const uint32_t EVENT_BUTTON = 1 << 0;
+const uint32_t EVENT_FRAME = 1 << 1;
+const uint32_t EVENT_SERIAL = 1 << 2;
+EventLoop events;
 
 // TX/RX variables
 esp_err_t sendStatus;
 
-// Command codes
-const uint8_t CMD_GAME_START = 0x01;
-const uint8_t CMD_GOOD_GUESS = 0x02;
-const uint8_t CMD_WRONG_GUESS = 0x03;
-const uint8_t CMD_GAME_WON = 0x04;
+// Runtime messages are logged as binary records and written out by a background task
+BinLog<64> binLog;
+size_t writeLog(const uint8_t *data, size_t len)
+{
+    return Serial.write(data, len);
+}
 
 // LED and button pins
 const uint8_t ledPins[4] = {17, 25, 4, 12};
 const uint8_t buttonPin = 13;
 
+// LED animations, played while frames and buttons keep being serviced.
+// Both blink all LEDs three times to inform the player, then pause with the LEDs off.
+LedAnimator<4> leds(ledPins);
+const Keyframe countdownAnimation[] = {{0x0F, 500}, {0x00, 500}, {0x0F, 500}, {0x00, 500}, {0x0F, 500}, {0x00, 1500}};
+const Keyframe gameOverAnimation[] = {{0x0F, 500}, {0x00, 500}, {0x0F, 500}, {0x00, 500}, {0x0F, 500}, {0x00, 3500}};
+
 // Difficulty level (0-15)
-volatile uint8_t difficulty = 0;
+uint8_t difficulty = 0;
 volatile bool difficultyLocked = false;
-volatile bool buttonInter = true;
 bool longPressed = false;
 bool shortPressed = false;
 
-// Debouncing
-volatile uint32_t lastDebounceTime = 0;
-const uint32_t debounceDelay = 50; // * toMillis; // 20ms debounce time
+// Debouncing: the button must hold a level this long for it to count
+const uint32_t debounceDelay = 50; // ms
 
 // Timing variables
-uint32_t buttonPressStart = 0;
-const uint32_t longPressDuration = 2000; //*toSecs; // 2 seconds
-
-// Random sequence variables
-const uint8_t maxSequenceLength = 15;
-uint8_t sequence[maxSequenceLength];
-uint8_t currentStep = 0;
+const uint32_t longPressDuration = 2000; // ms
+
+// The button, sampled on a timer while it moves; a long press counts as soon as it is long enough
+const uint8_t buttonPins[1] = {buttonPin};
+ButtonDebouncer<1> button(buttonPins, {debounceDelay, longPressDuration}, []
+                          { events.post(EVENT_BUTTON); });
+
+// Random sequence variables. A sequence has one step per difficulty level, from 1 to 16;
+// endurance builds make it 128 steps per level, up to 2048, to keep players going for hours.
+#ifdef ENDURANCE_MODE
+const uint16_t stepsPerLevel = 128;
+#else
+const uint16_t stepsPerLevel = 1;
+#endif
+const uint16_t maxSequenceLength = 16 * stepsPerLevel;
+
+// Where the sequences and session ids are drawn from: a PCG seeded at boot, from the hardware
+// RNG on boards, or with SEQUENCE_SEED in builds that must play the same sequences again, such
+// as the benchmark. Only the seed is random, so it is all a replay needs to draw the same values.
+#ifdef SEQUENCE_SEED
+uint32_t sequenceSeed = SEQUENCE_SEED;
+#endif
+HardwareRandom hardwareRandom;
+Pcg32 gameRandom(0);
+RandomSource *sequenceRandom = &gameRandom;
+
+// Game state of each remote. Every remote guesses its own random sequence; the first to finish wins.
+// Its steps come from a generator of its own, so they do not depend on the order remotes reach them.
+struct RemoteState
+{
+    PackedSequence<maxSequenceLength> sequence;
+    Pcg32 steps = Pcg32(0);
+    uint16_t currentStep = 0;
+    uint16_t guesses = 0; // In the current game
+    uint8_t wrongGuesses = 0;
+    uint16_t score = 0; // Games won
+    bool started = false; // Acknowledged the start of the current game, or paired after it began
+    DuplicateFilter sequences;
+};
+PeerTable<RemoteState, maxRemotes> remotes;
 
-// Player inputs
-volatile uint8_t guess;
-volatile bool guessed = false;
-const uint8_t idleGuess = 255;
+// Paired remotes as kept in NVS, with their lifetime wins
+struct StoredRemote
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint16_t wins;
+};
+StoredRemote storedRemotes[maxRemotes];
+
+// Games played since the manager was first flashed
+uint32_t gamesPlayed = 0;
+
+// Difficulty, pairings and statistics survive reboots. Writes are held back until
+// the manager is idle with nothing changing for 2s, and never for more than a minute.
+NvsCache<3> settings("manager", {2000, 60000});
+const uint32_t restoreBudget = 50000; // us
+
+// Every game won is appended to the history partition, which also keeps the 10 best ever played
+GameHistory<10> history;
+
+// Sending this byte over serial exports the history as binary log records. The export
+// is paced so the log ring always keeps room for the events of a game in progress.
+const char exportHistoryCommand = 'H';
+const size_t exportReserve = 16;  // Log records left free for everything else
+const uint32_t exportPeriod = 25; // ms between two batches
+bool exportingHistory = false;
+GameHistory<10>::Cursor exportCursor;
+uint32_t exportedGames = 0;
+
+// Every input since the boot, for the simulation to replay the session. The host gets
+// them with this command, through the log like the history.
+InputRecorder<32768> recorder;
+const char dumpInputsCommand = 'R';
+volatile uint32_t serialArrivedAt = 0; // micros()
+
+// Frames received from the remotes, pushed by the WiFi task and drained by loop()
+SpscQueue<ReceivedFrame, 32> rxQueue;
+
+// The CPU runs at 240 MHz from the countdown to the end of the game, when guesses must be
+// answered fast, and scales down to 80 MHz the rest of the time
+const int boostFrequency = 240; // MHz
+const int idleFrequency = 80;
+CpuBoost cpu({boostFrequency, idleFrequency});
+
+// Each game is a new session; sequence numbers restart with it. They are shared by
+// all remotes, so an ACK identifies its frame on its own.
+uint16_t session = 0;
+uint16_t txSequence = 0;
+
+// The game start is broadcast, then sent again to each remote that did not acknowledge it.
+// Every copy carries the time left until startAt, so all remotes begin the game together.
+const uint32_t startDelay = 200000; // us, room for a few retries
+const uint32_t startRetryPeriod = 40;
+const uint8_t maxStartAttempts = 6;
+uint16_t startSequence = 0;
+uint32_t startAt = 0; // micros()
+uint32_t lastStartSent = 0;
+uint8_t startAttempts = 0;
+
+// Outgoing data frames are retransmitted from loop() until the remote acknowledges them
+bool sendFrame(const uint8_t *mac, const uint8_t *data, size_t len)
+{
+    sendStatus = esp_now_send(mac, data, len);
+    return sendStatus == ESP_OK;
+}
+Retransmitter<32, maxFrameLength> retransmitter(sendFrame, {50, 800, 6}); // 50ms first retry, doubling up to 800ms, 6 attempts
 
 // ESP-NOW callback for data sent
 void onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
-    Serial.print("Packet Send Status: ");
-    Serial.println(status == ESP_NOW_SEND_SUCCESS ? "Success" : "Fail");
+    recorder.record(INPUT_SEND_STATUS, status, mac_addr, ESP_NOW_ETH_ALEN);
+    binLog.log(LOG_SEND_STATUS, status);
 }
 
 // Display difficulty using binary representation on LEDs
@@ -76,65 +193,284 @@ void displayDifficulty()
     }
 }
 
-// Generate a random sequence of numbers (1-3)
-void generateSequence()
+// Short id of a remote in the logs: the last two bytes of its MAC address
+uint16_t remoteId(const uint8_t *mac)
+{
+    return mac[4] << 8 | mac[5];
+}
+
+// Give each remote a new random sequence of numbers (1-3). Its steps are drawn as the remote reaches them.
+void generateSequences()
 {
-    Serial.println("Generating random sequence");
-    for (int i = 0; i <= difficulty; ++i)
+    uint16_t length = (difficulty + 1) * stepsPerLevel;
+    remotes.forEach([length](const uint8_t *, RemoteState &remote)
     {
-        sequence[i] = random(1, 4);
+        remote.sequence.reset(length);
+        remote.steps.seed(sequenceRandom->next());
+        remote.currentStep = 0;
+        remote.guesses = 0;
+        remote.wrongGuesses = 0;
+    });
+    binLog.log(LOG_SEQUENCE_GENERATED, length, remotes.size());
+}
+
+// The value the remote has to guess at step
+uint8_t sequenceStep(RemoteState &remote, uint16_t step)
+{
+    return remote.sequence.at(step, [&remote]()
+    {
+        return remote.steps.below(3) + 1;
+    });
+}
+
+// Hand a data frame numbered txSequence to the retransmitter, which resends it until acknowledged
+esp_err_t submitFrame(const uint8_t *mac, const uint8_t *frame, size_t len)
+{
+    if (!retransmitter.submit(txSequence, mac, frame, len, millis()))
+    {
+        return ESP_ERR_ESPNOW_NO_MEM;
     }
-    currentStep = 0;
+    return sendStatus;
+}
+
+// Send a command to a remote in a data frame
+esp_err_t sendCommand(const uint8_t *mac, uint8_t command)
+{
+    uint8_t frame[messageFrameLength];
+    return submitFrame(mac, frame, encodeMessage(frame, command, ++txSequence, session));
 }
 
-// Send game start command
+// Answer a guess, echoing its timestamp when the remote sent one
+esp_err_t sendVerdict(const uint8_t *mac, uint8_t verdict, const uint8_t *guess, size_t guessLength)
+{
+    uint32_t stamp;
+    if (!readStamp(guess, guessLength, stamp))
+    {
+        return sendCommand(mac, verdict);
+    }
+    uint8_t frame[stampedFrameLength];
+    return submitFrame(mac, frame, encodeStampedMessage(frame, verdict, stamp, ++txSequence, session));
+}
+
+// Send the game start to mac, with the time left until the game begins
+esp_err_t sendStart(const uint8_t *mac)
+{
+    int32_t startIn = startAt - micros();
+    uint8_t frame[stampedFrameLength];
+    size_t len = encodeStampedMessage(frame, CMD_GAME_START, startIn > 0 ? startIn : 0, startSequence, session);
+    lastStartSent = millis();
+    return esp_now_send(mac, frame, len);
+}
+
+// Broadcast the game start to every remote in a single frame, opening a new session
 esp_err_t sendGameStart()
 {
-    Serial.println("Sending game start command");
-    return esp_now_send(remoteMacAddress, &CMD_GAME_START, sizeof(CMD_GAME_START));
+    uint16_t previousSession = session;
+    do
+    {
+        session = sequenceRandom->below(0xFFFF) + 1;
+    } while (session == previousSession);
+    txSequence = 0;
+    remotes.forEach([](const uint8_t *, RemoteState &remote)
+    {
+        remote.sequences.reset();
+        remote.started = false;
+    });
+
+    startSequence = ++txSequence;
+    startAt = micros() + startDelay;
+    startAttempts = 1;
+    return sendStart(broadcastMacAddress);
 }
 
-// Process received data from remote node
-void onDataRecv(const uint8_t *mac, const uint8_t *incomingData, int len)
+// Unicast the start again to the remotes that did not acknowledge it
+void retryGameStart()
 {
-    if (state != States::playing)
+    if (startAttempts == 0 || millis() - lastStartSent < startRetryPeriod)
         return;
 
-    guessed = true;
-    guess = incomingData[0];
+    bool missing = false;
+    remotes.forEach([&missing](const uint8_t *mac, RemoteState &remote)
+    {
+        if (!remote.started)
+        {
+            sendStart(mac);
+            missing = true;
+        }
+    });
+    startAttempts = missing && startAttempts + 1 < maxStartAttempts ? startAttempts + 1 : 0;
+}
+
+// Milliseconds until retryGameStart() has to run, EventLoop::forever if it has nothing to do
+uint32_t nextStartRetryIn(uint32_t now)
+{
+    if (startAttempts == 0)
+        return EventLoop::forever;
+    return timeUntil(lastStartSent, startRetryPeriod, now);
+}
+
+// Copy the paired remotes and their wins to the settings, so they are peers again after a reboot
+void storeRemotes()
+{
+    size_t count = 0;
+    remotes.forEach([&count](const uint8_t *mac, RemoteState &remote)
+    {
+        memcpy(storedRemotes[count].mac, mac, ESP_NOW_ETH_ALEN);
+        storedRemotes[count++].wins = remote.score;
+    });
+    settings.touch(storedRemotes, count * sizeof(StoredRemote), millis());
+}
+
+// Register a remote as an ESP-NOW peer and give it a game state. Returns the state, nullptr on failure.
+RemoteState *addRemote(const uint8_t *mac, esp_err_t &status)
+{
+    status = remotes.full() ? ESP_ERR_ESPNOW_FULL : addPeer(mac);
+    if (status != ESP_OK && status != ESP_ERR_ESPNOW_EXIST)
+        return nullptr;
+    return remotes.insert(mac);
+}
+
+// Register the remotes restored from the settings
+void loadRemotes()
+{
+    for (size_t i = 0; i < settings.length(storedRemotes) / sizeof(StoredRemote); ++i)
+    {
+        esp_err_t status;
+        RemoteState *remote = addRemote(storedRemotes[i].mac, status);
+        if (!remote)
+        {
+            Serial.println("Failed to add peer.");
+            continue;
+        }
+        remote->score = storedRemotes[i].wins;
+    }
 }
 
-void updateButtonState()
+// Answer the announce of a remote: pair it on first contact, then welcome it.
+// Known remotes are welcomed again, in case they lost their own pairing.
+void pairRemote(const uint8_t *mac)
 {
-    bool buttonState = digitalRead(buttonPin);
-    if (buttonState && buttonPressStart > 0)
-    { // Only process when button is released
-        if (millis() - buttonPressStart >= longPressDuration)
+    if (!remotes.find(mac))
+    {
+        esp_err_t status;
+        RemoteState *remote = addRemote(mac, status);
+        if (!remote)
+        {
+            binLog.log(LOG_PAIRING_REFUSED, remoteId(mac), status);
+            return;
+        }
+        // It waits for the next game rather than join this one
+        remote->started = true;
+        storeRemotes();
+        binLog.log(LOG_REMOTE_PAIRED, remoteId(mac), remotes.size());
+    }
+
+    uint8_t frame[frameHeaderLength];
+    esp_now_send(mac, frame, encodeBare(frame, FRAME_WELCOME));
+}
+
+// Queue received data from remote node for loop() to process
+void onDataRecv(const uint8_t *mac, const uint8_t *incomingData, int len)
+{
+    recorder.recordFrame(mac, incomingData, len);
+    queueFrame(rxQueue, mac, incomingData, len);
+    events.post(EVENT_FRAME);
+}
+
+// Take the short and long presses the debouncer timed
+void processButtonEvents()
+{
+    button.drain([](const ButtonEvent &event)
+    {
+        if (event.kind == BUTTON_LONG_PRESS)
         {
             longPressed = true;
-            Serial.println("Long press detected!");
+            binLog.log(LOG_LONG_PRESS, event.held / 1000);
         }
-        else
+        else if (event.kind == BUTTON_SHORT_PRESS)
         {
             shortPressed = true;
-            Serial.println("Short press detected!");
+            binLog.log(LOG_SHORT_PRESS, event.held / 1000);
         }
+    });
+}
 
-        // Reset timing
-        buttonPressStart = 0;
+// Interrupt Service Routine for button press
+void IRAM_ATTR onButtonPress()
+{
+    recorder.recordPin(buttonPin, digitalRead(buttonPin));
+    button.edge(0);
+}
+
+// Store the game just won by the remote at mac in the history
+void recordGame(const uint8_t *mac, const RemoteState &remote)
+{
+    GameRecord record = {};
+    record.durationMs = (micros() - startAt) / 1000;
+    memcpy(record.mac, mac, ESP_NOW_ETH_ALEN);
+    record.difficulty = difficulty;
+    record.wrongGuesses = remote.wrongGuesses;
+    record.guesses = remote.guesses;
+
+    int rank;
+    esp_err_t status = history.append(record, &rank);
+    if (status != ESP_OK)
+    {
+        binLog.log(LOG_HISTORY_FAILED, status);
+    }
+    else if (rank >= 0)
+    {
+        binLog.log(LOG_HIGH_SCORE, record.game, rank + 1);
+    }
+}
+
+// Start an export of the history or a dump of the inputs when the host asks for one
+void readCommands()
+{
+    uint8_t commands[16];
+    size_t count = 0;
+    while (Serial.available() > 0 && count < sizeof(commands))
+    {
+        commands[count++] = Serial.read();
+    }
+    if (count == 0)
         return;
+    recorder.recordSerial(commands, count, serialArrivedAt);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (commands[i] == exportHistoryCommand && !exportingHistory)
+        {
+            exportingHistory = true;
+            exportCursor = history.oldest();
+            exportedGames = 0;
+        }
+        else if (commands[i] == dumpInputsCommand)
+        {
+            recorder.startDump();
+        }
+    }
+    if (Serial.available() > 0)
+    {
+        events.post(EVENT_SERIAL);
     }
-    buttonPressStart = !buttonState ? millis() : 0;
 }
 
-// Interrupt Service Routine for button press
-void IRAM_ATTR onButtonPress()
+// Log the next games of the history, oldest first, as long as the log ring has room for them
+void exportHistory()
 {
-    uint32_t currentMillis = millis();
-    if (currentMillis - lastDebounceTime > debounceDelay)
+    GameRecord record;
+    while (exportingHistory && binLog.hasRoom(exportReserve + 1))
     {
-        lastDebounceTime = currentMillis;
-        buttonInter = true;
+        if (!history.next(exportCursor, record))
+        {
+            binLog.log(LOG_HISTORY_END, exportedGames);
+            exportingHistory = false;
+            return;
+        }
+        binLog.log(LOG_HISTORY_RECORD, record.game, record.durationMs,
+                   record.difficulty | record.wrongGuesses << 8 | (uint32_t)record.guesses << 16, remoteId(record.mac));
+        exportedGames++;
     }
 }
 
@@ -142,58 +478,116 @@ void IRAM_ATTR onButtonPress()
 void increaseDifficulty()
 {
     difficulty = (difficulty + 1) % 16;
-    Serial.print("New difficulty: ");
-    Serial.println(difficulty);
+    settings.touch(&difficulty, millis());
+    binLog.log(LOG_DIFFICULTY_CHANGED, difficulty);
     displayDifficulty();
 }
 
-// Player guess logic
-void treatGuess()
+// Player guess logic. guess is the payload of the frame sent by the remote at mac.
+void treatGuess(const uint8_t *mac, RemoteState &remote, const uint8_t *guess, size_t guessLength, uint32_t receivedAt)
 {
-    Serial.print("Received guess: ");
-    Serial.println(guess);
-    if (guess == sequence[currentStep])
+    binLog.log(LOG_GUESS_RECEIVED, guess[0], micros() - receivedAt, remoteId(mac));
+    if (remote.guesses < UINT16_MAX)
+        remote.guesses++;
+    if (guessValues[guess[0]] != sequenceStep(remote, remote.currentStep))
     {
-        currentStep++;
-        if (currentStep > difficulty)
-        {
-            esp_now_send(remoteMacAddress, &CMD_GAME_WON, sizeof(CMD_GAME_WON));
-            state = States::game_over;
-        }
-        else
-        {
-            esp_now_send(remoteMacAddress, &CMD_GOOD_GUESS, sizeof(CMD_GOOD_GUESS));
-        }
+        if (remote.wrongGuesses < UINT8_MAX)
+            remote.wrongGuesses++;
+        sendVerdict(mac, CMD_WRONG_GUESS, guess, guessLength);
+        remote.currentStep = 0;
+        return;
     }
-    else
+
+    remote.currentStep++;
+    if (remote.currentStep < remote.sequence.length())
     {
-        esp_now_send(remoteMacAddress, &CMD_WRONG_GUESS, sizeof(CMD_WRONG_GUESS));
-        currentStep = 0;
+        sendVerdict(mac, CMD_GOOD_GUESS, guess, guessLength);
+        return;
     }
+
+    // First to finish: the game is over for everyone else
+    remote.score++;
+    gamesPlayed++;
+    settings.touch(&gamesPlayed, millis());
+    storeRemotes();
+    recordGame(mac, remote);
+    binLog.log(LOG_REMOTE_WON, remoteId(mac), remote.score);
+    sendVerdict(mac, CMD_GAME_WON, guess, guessLength);
+    remotes.forEach([&remote](const uint8_t *otherMac, RemoteState &other)
+    {
+        if (&other != &remote)
+            sendCommand(otherMac, CMD_GAME_OVER);
+    });
+    state = States::game_over;
+    leds.play(gameOverAnimation, millis());
 }
 
-// Blink all LEDs to inform the player
-void alertBlink()
+// Acknowledge and dispatch the frames queued by onDataRecv
+void processFrames()
 {
-    for (int i = 0; i < 3; ++i)
+    rxQueue.drain([](const ReceivedFrame &frame)
     {
-        for (int j = 0; j < 4; ++j)
+        FrameHeader header;
+        const uint8_t *payload;
+        size_t payloadLength;
+        if (!decodeFrame(frame.data, frame.len, header, payload, payloadLength))
+            return;
+
+        if (header.type == FRAME_ANNOUNCE)
         {
-            digitalWrite(ledPins[j], HIGH);
+            pairRemote(frame.mac);
+            return;
         }
-        delay(500);
-        for (int j = 0; j < 4; ++j)
+
+        RemoteState *remote = remotes.find(frame.mac);
+        if (!remote)
         {
-            digitalWrite(ledPins[j], LOW);
+            binLog.log(LOG_UNKNOWN_PEER, remoteId(frame.mac));
+            return;
         }
-        delay(500);
-    }
+
+        if (header.type == FRAME_ACK)
+        {
+            if (header.session != session)
+                return;
+            if (header.sequence == startSequence)
+                remote->started = true;
+            else
+                retransmitter.acknowledge(header.sequence);
+            return;
+        }
+
+        // Any other type is unknown to this version: it is neither acknowledged nor read
+        if (header.type != FRAME_DATA)
+            return;
+        sendAck(frame.mac, header);
+
+        // Guesses from an older game, duplicates and guesses outside of a game are dropped
+        if (header.session != session)
+            return;
+        if (!remote->sequences.accept(header.sequence) || state != States::playing)
+            return;
+        treatGuess(frame.mac, *remote, payload, payloadLength, frame.timestamp);
+    });
 }
 
 void setup()
 {
-    // Monitor init
+    // Interrupts and ESP-NOW callbacks wake up the task running loop()
+    bool ownCore = events.begin();
+
+    // Monitor init, taking commands from the host too
     Serial.begin(115200);
+    Serial.onReceive([]()
+    {
+        serialArrivedAt = micros();
+        events.post(EVENT_SERIAL);
+    });
+    binLog.begin(writeLog, 50, radioCore); // Keeps the serial writes off the game's core
+    if (!ownCore)
+    {
+        Serial.printf("loop() runs on core %d, with the radio's work.\n", (int)xPortGetCoreID());
+    }
     Serial.print("CPU Frequency: ");
     Serial.print(getCpuFrequencyMhz());
     Serial.println(" MHz");
@@ -203,6 +597,15 @@ void setup()
     Serial.print("Game manager MAC Address: ");
     Serial.println(WiFi.macAddress());
 
+    // Seed the game's random draws; the radio is on, which the hardware RNG needs for true entropy
+#ifdef SEQUENCE_SEED
+    uint32_t seed = sequenceSeed;
+#else
+    uint32_t seed = hardwareRandom.next();
+#endif
+    recorder.record(INPUT_ENTROPY, 0, &seed, sizeof(seed));
+    gameRandom.seed(seed);
+
     // Initialize LEDs and button
     for (int i = 0; i < 4; ++i)
     {
@@ -210,6 +613,7 @@ void setup()
         digitalWrite(ledPins[i], LOW);
     }
     pinMode(buttonPin, INPUT_PULLUP);
+    button.begin();
     attachInterrupt(buttonPin, onButtonPress, CHANGE);
 
     // ESP-NOW init
@@ -220,106 +624,168 @@ void setup()
     }
     esp_now_register_send_cb(onDataSent);
     esp_now_register_recv_cb(onDataRecv);
+
+    // Frequency scaling, under the WiFi driver's own power management lock
+    esp_err_t pmStatus = cpu.begin();
+    if (pmStatus == ESP_OK)
+    {
+        Serial.printf("CPU frequency scaled down to %u MHz while idle.\n", (unsigned)getCpuFrequencyMhz());
+    }
+    else
+    {
+        Serial.printf("WARNING: CPU frequency scaling unavailable (error 0x%x), the CPU stays at %u MHz. "
+                      "It needs CONFIG_PM_ENABLE (see sdkconfig.defaults).\n",
+                      pmStatus, (unsigned)getCpuFrequencyMhz());
+    }
     
-    // Adding the remote to the peers for communication
-    esp_now_peer_info_t peerInfo = {};
-    memcpy(peerInfo.peer_addr, remoteMacAddress, 6);
-    peerInfo.channel = 1;
-    peerInfo.encrypt = false;
+    // Settings saved before the last reboot, in order of importance in case the budget runs out
+    settings.bind("difficulty", &difficulty, sizeof(difficulty));
+    settings.bind("remotes", storedRemotes, sizeof(storedRemotes), sizeof(StoredRemote));
+    settings.bind("games", &gamesPlayed, sizeof(gamesPlayed));
+    uint32_t restoreStart = micros();
+    size_t restored = settings.restore(restoreBudget);
+    Serial.printf("Restored %u settings in %u us; %u games played so far.\n",
+                  (unsigned)restored, (unsigned)(micros() - restoreStart), (unsigned)gamesPlayed);
+    settings.forEachRestored([](const char *name, const char *key, const void *data, size_t length)
+    {
+        recorder.recordNvs(name, key, data, length);
+    });
+    // A difficulty out of range, from a corrupted entry, would ask for longer sequences than fit
+    if (difficulty >= 16)
+    {
+        difficulty %= 16;
+        settings.touch(&difficulty, millis());
+    }
 
-    if (esp_now_is_peer_exist(remoteMacAddress))
+    // History of the games, in its own flash partition (see partitions.csv)
+    if (history.begin("history"))
     {
-        Serial.println("Peer already added.");
+        Serial.printf("History: %u games stored, %u high scores.\n", (unsigned)history.size(), (unsigned)history.highScores());
     }
     else
     {
-        if (esp_now_add_peer(&peerInfo) == ESP_OK)
-        {
-            Serial.println("Peer added successfully.");
-        }
-        else
-        {
-            Serial.println("Failed to add peer.");
-        }
+        Serial.println("No history partition, games will not be recorded.");
     }
 
+    // The broadcast address for game starts, then the remotes paired before. Holding
+    // the button during boot forgets them; they pair again as they announce themselves.
+    addPeer(broadcastMacAddress);
+    recorder.recordPin(buttonPin, digitalRead(buttonPin));
+    if (digitalRead(buttonPin) == LOW)
+    {
+        settings.touch(storedRemotes, 0, millis());
+        settings.flush();
+        Serial.println("Pairings cleared.");
+    }
+    loadRemotes();
+    Serial.print("Remotes: ");
+    Serial.println(remotes.size());
+
     // Initial state
     Serial.println("Initialization complete. Waiting for game start command.");
     state = States::idle;
+    previousState = state;
     displayDifficulty();
+    recorder.record(INPUT_READY, 0);
 }
 
 void loop()
 {
+    // Sleep until a button press, a frame, a command, a retransmission, a start retry, a keyframe,
+    // a settings write or the next batch of an export or dump is due, unless the last pass changed state
+    uint32_t timeout = min(min(retransmitter.nextPollIn(millis()), nextStartRetryIn(millis())), leds.nextUpdateIn(millis()));
+    timeout = min(timeout, settings.nextPollIn(millis(), state == States::idle));
+    if (exportingHistory || recorder.dumpInProgress())
+    {
+        timeout = min(timeout, exportPeriod);
+    }
+    events.wait(state == previousState ? timeout : 0);
+    previousState = state;
+    leds.update(millis());
+
+    if (events.take(EVENT_FRAME))
+    {
+        processFrames();
+    }
+    retransmitter.poll(millis());
+    retryGameStart();
+
+    if (events.take(EVENT_BUTTON))
+    {
+        processButtonEvents();
+    }
+
+    if (events.take(EVENT_SERIAL))
+    {
+        readCommands();
+    }
+    exportHistory();
+    recorder.continueDump(binLog, exportReserve);
+
+    // Flash writes stall the CPU, so they wait for the manager to be idle when they can
+    size_t saved = settings.poll(millis(), state == States::idle);
+    if (saved > 0)
+    {
+        binLog.log(LOG_SETTINGS_SAVED, saved);
+    }
+
     switch (state)
     {
     case States::idle:
         // Button pressed servicing
-        if (buttonInter)
+        if (longPressed)
+        {
+            state = States::countdown;
+            leds.play(countdownAnimation, millis());
+        }
+        else if (shortPressed)
         {
-            updateButtonState();
-            if (longPressed)
-            {
-                generateSequence();
-                state = States::countdown;
-                longPressed = false;
-            }
-            else if (shortPressed)
-            {
-                increaseDifficulty();
-                shortPressed = false;
-            }
-            buttonInter = false;
+            increaseDifficulty();
         }
         break;
     
     case States::countdown:
-        alertBlink();
-        delay(1000);
-        Serial.println("Sending start signal");
-        sendStatus = sendGameStart();
-        Serial.print("Send status: ");
-        switch (sendStatus)
+        if (leds.playing())
         {
-            case ESP_OK:
-                Serial.println("ESP_OK");
-                break;
-            case ESP_ERR_ESPNOW_NOT_INIT:
-                Serial.println("ESP_ERR_ESPNOW_NOT_INIT");
-                break;
-            case ESP_ERR_ESPNOW_ARG:
-                Serial.println("ESP_ERR_ESPNOW_ARG");
-                break;
-            case ESP_ERR_ESPNOW_INTERNAL:
-                Serial.println("ESP_ERR_ESPNOW_INTERNAL");
-                break;
-            case ESP_ERR_ESPNOW_NO_MEM:
-                Serial.println("ESP_ERR_ESPNOW_NO_MEM");
-                break;
-            case ESP_ERR_ESPNOW_NOT_FOUND:
-                Serial.println("ESP_ERR_ESPNOW_NOT_FOUND");
-                break;
-            case ESP_ERR_ESPNOW_IF:
-                Serial.println("ESP_ERR_ESPNOW_IF");
-                break;
+            break;
         }
+        // Remotes paired during the countdown get a sequence too
+        generateSequences();
+        sendStatus = sendGameStart();
+        binLog.log(LOG_GAME_START_SENT, session, sendStatus);
         state = States::playing;
+        displayDifficulty();
         break;
 
     case States::playing:
-        displayDifficulty();
-        if (guessed)
-        {
-            treatGuess();
-            guessed = false;
-        }
-    break;
+        // Guesses are handled as their frames come in
+        break;
 
     case States::game_over:
-        alertBlink();
-        delay(3000);
+        if (leds.playing())
+        {
+            break;
+        }
+        if (rxQueue.dropped() > 0)
+        {
+            binLog.log(LOG_GUESSES_DROPPED, rxQueue.dropped());
+        }
         state = States::idle;
         difficultyLocked = false;
         break;
     }
+
+    // Presses only count while idle
+    longPressed = false;
+    shortPressed = false;
+
+    // Switch the clock with the state it is needed for, and tell how much time went at each frequency
+    if (cpu.boost(state == States::countdown || state == States::playing))
+    {
+        binLog.log(LOG_CPU_FREQUENCY, getCpuFrequencyMhz(), cpu.lastSwitchUs());
+        if (!cpu.isBoosted())
+        {
+            binLog.log(LOG_CPU_TIME, cpu.timeBoostedUs() / 1000, boostFrequency, cpu.timeScaledUs() / 1000, cpu.switches());
+        }
+    }
 }
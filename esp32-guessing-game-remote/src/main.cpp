@@ -5,133 +5,417 @@ Made by Valérian Grégoire--Bégranger -- 2025
 *******************************************************************************/
 
 #include <Arduino.h>
+#include <Preferences.h>
 #include <WiFi.h>
 #include <esp_now.h>
+#include <esp_timer.h>
+#include <BinLog.h>
+#include <ButtonDebouncer.h>
+#include <EspNowLink.h>
+#include <EventLoop.h>
+#include <GuessProtocol.h>
+#include <InputRecorder.h>
+#include <LatencyStats.h>
+#include <LedBreather.h>
+#include <PowerManager.h>
+#include <Retransmitter.h>
+#include <SequenceRandom.h>
+#include <SpscQueue.h>
 
-// Remote MAC address: 30:C9:22:FF:81:D0
-// Game Manager MAC address: 30:C9:22:FF:71:AC
-uint8_t macAddress[6] = {0x30, 0xC9, 0x22, 0xFF, 0x71, 0xAC};
+// Outgoing data frames are retransmitted from loop() until the manager acknowledges them
+bool sendFrame(const uint8_t *mac, const uint8_t *data, size_t len)
+{
+    return esp_now_send(mac, data, len) == ESP_OK;
+}
+Retransmitter<4, maxFrameLength> retransmitter(sendFrame, {50, 800, 6}); // 50ms first retry, doubling up to 800ms, 6 attempts
+
+// Runtime messages are logged as binary records and written out by a background task
+BinLog<64> binLog;
+size_t writeLog(const uint8_t *data, size_t len)
+{
+    return Serial.write(data, len);
+}
+
+// An unpaired remote announces itself until a manager welcomes it, then keeps that manager in NVS
+const uint32_t announcePeriod = 1000;
+const uint32_t announceJitter = 200; // Spreads the announces of remotes powered on together
+uint8_t managerMac[ESP_NOW_ETH_ALEN];
+bool paired = false;
+uint32_t lastAnnounce = 0;
+uint32_t announceDelay = 0;
+
+// Draws the announce jitter (and the benchmark's guesses). Seeded once from the hardware RNG,
+// so the seed is the only random input a replay needs.
+HardwareRandom hardwareRandom;
+Pcg32 remoteRandom(0);
 
-// Message buffer for retries
-uint8_t lastSentMessage;
+// Every input since the boot, for the simulation to replay the session. The host gets them
+// with this command, through the log, leaving room in the ring for a game in progress.
+InputRecorder<32768> recorder;
+const char dumpInputsCommand = 'R';
+const size_t dumpReserve = 16;  // Log records left free for everything else
+const uint32_t dumpPeriod = 25; // ms between two batches
+volatile uint32_t serialArrivedAt = 0; // micros()
 
+// Session of the current game, adopted from the manager's start command
+uint16_t session = 0;
+uint16_t txSequence = 0;
+DuplicateFilter managerSequences;
+
+// Frames and send statuses, pushed by the WiFi task and handled by loop()
+struct SendStatus
+{
+    esp_now_send_status_t status;
+    uint32_t time; // esp_timer_get_time() of the callback, in us
+};
+SpscQueue<ReceivedFrame, 8> rxQueue;
+SpscQueue<SendStatus, 8> sendStatuses;
 
 // State machine variables
 enum class States
 {
+    pairing,
     ready,
+    starting,
     playing,
     guessed,
     correct,
     wrong,
-    won
+    won,
+    lost
 };
 States state;
+States previousState;
+
+// FSM flags: SIGNAL_* bits raised by the manager's commands. The states showing a verdict or
+// the outcome of a game leave them be, so a command that comes meanwhile waits for the state after.
+uint8_t signals = 0;
 
-// FSM flags
-volatile bool startSignal = false;
-volatile bool rightGuess = false;
-volatile bool wrongGuess = false;
-volatile bool wonSignal = false;
+// micros() at which the manager starts the game, and at which this remote did
+uint32_t startAt = 0;
+uint32_t playStartedAt = 0;
 
-// Command codes
-const uint8_t CMD_GAME_START = 0x01;
-const uint8_t CMD_GOOD_GUESS = 0x02;
-const uint8_t CMD_WRONG_GUESS = 0x03;
-const uint8_t CMD_GAME_WON = 0x04;
+// Events waking up loop()
+const uint32_t EVENT_FRAME = 1 << 0;
+const uint32_t EVENT_SEND_STATUS = 1 << 1;
+const uint32_t EVENT_FADE_END = 1 << 2;
+const uint32_t EVENT_SERIAL = 1 << 3;
+const uint32_t EVENT_BUTTON = 1 << 4;
+EventLoop events;
 
-// Button handling
-const uint8_t buttonsCount = 3;
+// Button handling. The buttons are sampled on a timer while they move, and loop() guesses
+// with their presses one at a time in the order they came, so quick presses each count.
+const uint8_t buttonsCount = guessButtons;
 const uint8_t buttonPins[buttonsCount] = {13, 14, 26};
-volatile bool buttonPressed[buttonsCount] = {false, false, false};
-uint32_t lastDebounceTime[buttonsCount] = {0, 0, 0};
 const uint32_t debounceDelay = 20; // 20ms debounce time
+ButtonDebouncer<buttonsCount> buttons(buttonPins, {debounceDelay}, []
+                                      { events.post(EVENT_BUTTON); });
+
+// Power: the chip sleeps whenever its tasks are all waiting, and the buttons wake it. The radio
+// listens RADIO_WAKE_WINDOW_MS out of every RADIO_WAKE_INTERVAL_MS; a deployment can shorten the
+// window to save more, at the cost of the manager's frames waiting for a retransmission to get in.
+// ALWAYS_AWAKE builds never sleep, for the lowest latency.
+#ifndef RADIO_WAKE_INTERVAL_MS
+#define RADIO_WAKE_INTERVAL_MS 100
+#endif
+#ifndef RADIO_WAKE_WINDOW_MS
+#define RADIO_WAKE_WINDOW_MS RADIO_WAKE_INTERVAL_MS
+#endif
+
+// The manager sends a frame again 50, 150, 350, 750 and 1550 ms after the first attempt, its
+// retries backing off from 50 to 800 ms. Whatever the phase of the radio's wakes, one of those
+// attempts must fall in a window, or the frame is lost. With the default interval of 100 ms,
+// the attempts are all half an interval apart, so a window of half the interval is enough.
+constexpr bool hearsAnAttempt(uint32_t interval, uint32_t window)
+{
+    const uint32_t attempts[] = {0, 50, 150, 350, 750, 1550};
+    for (uint32_t phase = 0; phase < interval; ++phase)
+    {
+        bool heard = false;
+        for (uint32_t at : attempts)
+        {
+            heard = heard || (phase + at) % interval < window;
+        }
+        if (!heard)
+            return false;
+    }
+    return true;
+}
+static_assert(hearsAnAttempt(RADIO_WAKE_INTERVAL_MS, RADIO_WAKE_WINDOW_MS), "Wake window too short for the manager's retries");
+
+#ifdef ALWAYS_AWAKE
+const bool lightSleep = false;
+#else
+const bool lightSleep = true;
+#endif
+PowerManager<buttonsCount> power(buttonPins, {lightSleep, RADIO_WAKE_INTERVAL_MS, RADIO_WAKE_WINDOW_MS});
+
+// From a press to its guess being on air: what waking up costs, reported after each game
+LatencyStats guessLatency;
+uint16_t guessSequence = 0;
+bool guessInFlight = false;
+uint32_t guessPressedAt = 0;
+
+#ifdef BENCHMARK_MODE
+// Benchmark: guess random buttons as fast as verdicts come back, timestamping
+// every guess, and report the round-trip latency from press to verdict
+const uint32_t feedbackDuration = 10;
+const uint32_t benchmarkReportEvery = 1000;
+LatencyStats roundTrips;
+uint32_t roundTripsReported = 0; // Count of round trips at the last report
+#else
+const uint32_t feedbackDuration = 2000; // How long a verdict is shown
+#endif
+
+// Give up on a verdict after this long. Every retransmission of the guess and
+// of the verdict fits in it, so it only fires when the manager dropped the answer.
+const uint32_t verdictTimeout = 3000;
 
 // LED pins
 const uint8_t redLed = 12;
 const uint8_t greenLed = 4;
 
+// Breathing of the ready state, faded by the LEDC hardware with a period of 2 pi seconds
+const uint8_t breathingLeds[2] = {redLed, greenLed};
+LedBreather breather(breathingLeds, 6283);
+
 // Timer for LED states
 uint32_t lastStateUpdate = 0;
-uint32_t lastBreatheUpdate = 0;
 uint32_t lastBlinkUpdate = 0;
 
-// Ignore received commands flag
-bool locked;
-
-// Callback when data is sent
+// Callback when data is sent. Runs in the WiFi task, so it only queues the status.
 void onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
-    Serial.print("Last Packet Send Status: ");
-    Serial.println(status == ESP_NOW_SEND_SUCCESS ? "Success" : "Fail");
-    
-    uint8_t retries = 0;
-    while (status != ESP_NOW_SEND_SUCCESS && retries++ < 5)
+    recorder.record(INPUT_SEND_STATUS, status, mac_addr, ESP_NOW_ETH_ALEN);
+    sendStatuses.push({status, (uint32_t)esp_timer_get_time()});
+    events.post(EVENT_SEND_STATUS);
+}
+
+// Report send statuses and resend the frames due for a retry
+void serviceRetransmissions()
+{
+    SendStatus sent;
+    events.take(EVENT_SEND_STATUS);
+    while (sendStatuses.pop(sent))
     {
-        // Serial.printf("Resending... Attempt %d\n", retries);
-        esp_err_t result = esp_now_send(mac_addr, &lastSentMessage, sizeof(lastSentMessage));
-        delay(100);
+        // Delivery is confirmed by the manager's ACK, the status is only informative. It times
+        // the guess though, matched with its frame among the ACKs and announces sent around it.
+        int32_t message = retransmitter.matchSendStatus();
+        binLog.log(LOG_SEND_STATUS, sent.status);
+        if (guessInFlight && message == guessSequence && sent.status == ESP_NOW_SEND_SUCCESS)
+        {
+            guessLatency.record(sent.time - guessPressedAt);
+            guessInFlight = false;
+        }
     }
-    
-    if (retries == 5)
+
+    if (retransmitter.poll(millis()) > 0)
     {
-        Serial.println("Failed to send after 5 attempts");
+        binLog.log(LOG_SEND_ABANDONED, retransmitter.lastAbandoned());
+        // Let the player guess again rather than wait for an answer that will never come
+        if (state == States::guessed)
+        {
+            state = States::playing;
+        }
     }
 }
 
-// Callback to receive data
+// Callback to receive data. Runs in the WiFi task, so it only queues the frame.
 void onDataRecv(const uint8_t *mac, const uint8_t *incomingData, int len)
 {
-    if (!locked)
+    recorder.recordFrame(mac, incomingData, len);
+    queueFrame(rxQueue, mac, incomingData, len);
+    events.post(EVENT_FRAME);
+}
+
+// Adopt the manager that welcomed this remote, and remember it for the next boots
+void pairWith(const uint8_t *mac)
+{
+    if (addPeer(mac) != ESP_OK)
+        return;
+    memcpy(managerMac, mac, ESP_NOW_ETH_ALEN);
+    paired = true;
+
+    Preferences preferences;
+    preferences.begin(pairingNamespace);
+    preferences.putBytes("manager", managerMac, ESP_NOW_ETH_ALEN);
+    preferences.end();
+    binLog.log(LOG_PAIRED, mac[4] << 8 | mac[5]);
+}
+
+// Look for the manager paired before the last reboot. Returns true if it was found.
+bool loadPairing()
+{
+    Preferences preferences;
+    if (!preferences.begin(pairingNamespace, true))
+        return false;
+    paired = preferences.getBytes("manager", managerMac, ESP_NOW_ETH_ALEN) == ESP_NOW_ETH_ALEN;
+    preferences.end();
+    if (paired)
     {
-        if (len != 1)
+        recorder.recordNvs(pairingNamespace, "manager", managerMac, ESP_NOW_ETH_ALEN);
+    }
+    return paired;
+}
+
+// Acknowledge the queued frames and raise the FSM flags for the manager's commands
+void processFrames()
+{
+    rxQueue.drain([](const ReceivedFrame &frame)
+    {
+        FrameHeader header;
+        const uint8_t *payload;
+        size_t payloadLength;
+        if (!decodeFrame(frame.data, frame.len, header, payload, payloadLength))
+            return;
+
+        if (header.type == FRAME_WELCOME)
         {
-            return; // Expecting single byte commands
+            if (!paired)
+                pairWith(frame.mac);
+            return;
         }
-        uint8_t command = incomingData[0];
-        switch (command)
+
+        // Only the manager this remote is paired with is listened to
+        if (!paired || memcmp(frame.mac, managerMac, ESP_NOW_ETH_ALEN) != 0)
+            return;
+
+        if (header.type == FRAME_ACK)
         {
-        case CMD_GAME_START:
-            startSignal = true;
-            break;
-        case CMD_GOOD_GUESS:
-            rightGuess = true;
-            break;
-        case CMD_WRONG_GUESS:
-            wrongGuess = true;
-            break;
-        case CMD_GAME_WON:
-            wonSignal = true;
-            break;
+            if (header.session == session)
+                retransmitter.acknowledge(header.sequence);
+            return;
         }
-    }
+        // Any other type is unknown to this version: it is neither acknowledged nor read
+        if (header.type != FRAME_DATA)
+            return;
+
+        // Commands are acknowledged at once, even while a verdict is shown: the manager
+        // gives up retransmitting well before the end of that. Their signals wait for it.
+        uint8_t command = payload[0];
+        if (sendAck(frame.mac, header))
+        {
+            retransmitter.sentUntracked();
+        }
+
+        // A start command from a new session begins a new game, whatever was left of the last one
+        if (command == CMD_GAME_START && header.session != session)
+        {
+            session = header.session;
+            txSequence = 0;
+            managerSequences.reset();
+            signals = 0;
+        }
+        if (header.session != session || !managerSequences.accept(header.sequence))
+            return;
+
+        signals |= commandSignals[command];
+
+        // The start carries the delay until the game begins, counted from its reception
+        uint32_t value;
+        if (command == CMD_GAME_START)
+        {
+            startAt = frame.timestamp + (readStamp(payload, payloadLength, value) ? value : 0);
+            return;
+        }
+
+#ifdef BENCHMARK_MODE
+        // Only verdicts echo the timestamp of a guess
+        if (readStamp(payload, payloadLength, value))
+        {
+            roundTrips.record((uint32_t)esp_timer_get_time() - value);
+        }
+#endif
+    });
 }
+
+#ifdef BENCHMARK_MODE
+// Print the round-trip percentiles every benchmarkReportEvery guesses. Called
+// after the frames are drained, so the slow print does not delay the verdicts
+// still queued behind it and end up in the latencies it reports.
+void reportRoundTrips()
+{
+    if (roundTrips.count() - roundTripsReported < benchmarkReportEvery)
+        return;
+    roundTripsReported = roundTrips.count();
+    Serial.printf("Round trip over %u guesses: p50 %u us, p95 %u us, p99 %u us (min %u, max %u)\n",
+                  (unsigned)roundTrips.count(), (unsigned)roundTrips.percentile(0.50),
+                  (unsigned)roundTrips.percentile(0.95), (unsigned)roundTrips.percentile(0.99),
+                  (unsigned)roundTrips.min(), (unsigned)roundTrips.max());
+}
+#endif
+// LEDC interrupt at the end of a breathing fade: wake loop() to start the next one
+bool IRAM_ATTR onFadeEnd(const ledc_cb_param_t *, void *)
+{
+    events.postFromISR(EVENT_FADE_END);
+    return false;
+}
+
 // Button interrupt handlers
 void IRAM_ATTR onButtonPress(int buttonIndex)
 {
-    uint32_t currentTime = millis();
-    
-    // Only take the first press into consideration
-    if (currentTime - lastDebounceTime[buttonIndex] > debounceDelay)
-    {
-        buttonPressed[buttonIndex] = true;
-        lastDebounceTime[buttonIndex] = currentTime;
-    }
+    recorder.recordPin(buttonPins[buttonIndex], digitalRead(buttonPins[buttonIndex]));
+    buttons.edge(buttonIndex);
 }
 
 void IRAM_ATTR onButton1Press() { onButtonPress(0); }
 void IRAM_ATTR onButton2Press() { onButtonPress(1); }
 void IRAM_ATTR onButton3Press() { onButtonPress(2); }
 
+// Start a dump of the inputs when the host asks for one
+void readCommands()
+{
+    uint8_t commands[16];
+    size_t count = 0;
+    while (Serial.available() > 0 && count < sizeof(commands))
+    {
+        commands[count++] = Serial.read();
+    }
+    if (count == 0)
+        return;
+    recorder.recordSerial(commands, count, serialArrivedAt);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (commands[i] == dumpInputsCommand)
+        {
+            recorder.startDump();
+        }
+    }
+    if (Serial.available() > 0)
+    {
+        events.post(EVENT_SERIAL);
+    }
+}
+
 void setup()
 {
+    // Interrupts and ESP-NOW callbacks wake up the task running loop()
+    bool ownCore = events.begin();
+
+    // Monitor init, taking commands from the host too
     Serial.begin(115200);
+    Serial.onReceive([]()
+    {
+        serialArrivedAt = micros();
+        events.post(EVENT_SERIAL);
+    });
+    binLog.begin(writeLog, 50, radioCore); // Keeps the serial writes off the game's core
+    if (!ownCore)
+    {
+        Serial.printf("loop() runs on core %d, with the radio's work.\n", (int)xPortGetCoreID());
+    }
     Serial.println("Running as remote node.");
     
     // WiFi setup
     WiFi.mode(WIFI_STA);
     Serial.print("Remote MAC Address: ");
     Serial.println(WiFi.macAddress());
+
+    // The radio is on, which the hardware RNG needs for true entropy
+    uint32_t seed = hardwareRandom.next();
+    recorder.record(INPUT_ENTROPY, 0, &seed, sizeof(seed));
+    remoteRandom.seed(seed);
     
     // ESP-NOW init
     if (esp_now_init() != ESP_OK)
@@ -141,146 +425,358 @@ void setup()
     }
     esp_now_register_send_cb(onDataSent);
     esp_now_register_recv_cb(onDataRecv);
-    
-    esp_now_peer_info_t peerInfo = {};
-    memcpy(peerInfo.peer_addr, macAddress, 6);
-    peerInfo.channel = 1;
-    peerInfo.encrypt = false;
-    
-    if (esp_now_add_peer(&peerInfo) != ESP_OK)
-    {
-        Serial.println("Failed to add peer");
-        return;
-    }
 
-    // Initialize buttons with interrupts
+    // Initialize buttons with interrupts, on both edges for the debouncer to see releases too
     for (int i = 0; i < buttonsCount; ++i)
     {
         pinMode(buttonPins[i], INPUT_PULLUP);
     }
-    attachInterrupt(buttonPins[0], onButton1Press, FALLING);
-    attachInterrupt(buttonPins[1], onButton2Press, FALLING);
-    attachInterrupt(buttonPins[2], onButton3Press, FALLING);
+    buttons.begin();
+    attachInterrupt(buttonPins[0], onButton1Press, CHANGE);
+    attachInterrupt(buttonPins[1], onButton2Press, CHANGE);
+    attachInterrupt(buttonPins[2], onButton3Press, CHANGE);
+
+    // Sleep between events from now on, unless the build keeps the chip awake
+    esp_err_t powerStatus = power.begin();
+    if (powerStatus != ESP_OK)
+    {
+        Serial.printf("WARNING: light sleep unavailable (error 0x%x), the remote stays awake. "
+                      "It needs CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE (see sdkconfig.defaults).\n",
+                      powerStatus);
+    }
 
     // LED setup
     pinMode(redLed, OUTPUT);
     pinMode(greenLed, OUTPUT);
+    if (!breather.begin(onFadeEnd, nullptr))
+    {
+        Serial.println("Failed to set up the LED fades");
+    }
+
+    // Reconnect to the manager paired before, unless the first button is held during boot
+    addPeer(broadcastMacAddress);
+    recorder.recordPin(buttonPins[0], digitalRead(buttonPins[0]));
+    if (digitalRead(buttonPins[0]) == LOW)
+    {
+        Preferences preferences;
+        preferences.begin(pairingNamespace);
+        preferences.clear();
+        preferences.end();
+        Serial.println("Pairing cleared.");
+    }
+    if (loadPairing() && addPeer(managerMac) != ESP_OK)
+    {
+        Serial.println("Failed to add peer");
+        paired = false;
+    }
 
     // Initial state
-    state = States::ready;
-    Serial.println("Remote initialized; Waiting for the game to start.");
+    if (paired)
+    {
+        state = States::ready;
+        Serial.println("Remote initialized; Waiting for the game to start.");
+    }
+    else
+    {
+        state = States::pairing;
+        lastAnnounce = millis();
+        announceDelay = remoteRandom.below(announceJitter);
+        Serial.println("Remote initialized; Looking for a game manager.");
+    }
+    previousState = state;
+    recorder.record(INPUT_READY, 0);
 }
 
-bool sendButtonPress(int buttonIndex)
+// Guess with a button pressed at pressedAt, esp_timer_get_time() in us
+bool sendButtonPress(int buttonIndex, uint32_t pressedAt)
 {
     uint8_t buttonCode = buttonIndex + 1; // Send 1, 2, or 3 for button presses
-    lastSentMessage = buttonCode;
-    esp_err_t result = esp_now_send(macAddress, &buttonCode, sizeof(buttonCode));
-    if (result == ESP_OK)
+#ifdef BENCHMARK_MODE
+    uint8_t frame[stampedFrameLength];
+    size_t len = encodeStampedMessage(frame, buttonCode, pressedAt, ++txSequence, session);
+#else
+    uint8_t frame[messageFrameLength];
+    size_t len = encodeMessage(frame, buttonCode, ++txSequence, session);
+#endif
+    if (retransmitter.submit(txSequence, managerMac, frame, len, millis()))
     {
+        guessSequence = txSequence;
+        guessPressedAt = pressedAt;
+        guessInFlight = true;
         state = States::guessed;
         return true;
     }
     else
     {
-        Serial.println("Failed to send button press.");
+        binLog.log(LOG_GUESS_NOT_SENT);
         return false;
     }
 }
 
-void breatheLeds()
+// Guess with the next press queued during the game. The presses after it wait in the queue for the verdict.
+void guessNextPress()
+{
+    ButtonEvent event;
+    while (buttons.pop(event))
+    {
+        if (event.kind != BUTTON_PRESS)
+            continue;
+
+        if (sendButtonPress(event.button, event.time))
+        {
+            binLog.log(LOG_GUESS_SENT, event.button, esp_timer_get_time() - event.time);
+            lastStateUpdate = millis();
+        }
+        return;
+    }
+}
+
+// Report how quickly the guesses went out so far, light sleep and all
+void logGuessLatency()
 {
-    if (millis() - lastBreatheUpdate >= 20)
+    if (guessLatency.count() > 0)
     {
-        float r_intensity = (sin(millis() / 1000.0) * 127) + 128;
-        float g_intensity = (cos(millis() / 1000.0) * 127) + 128;
-        analogWrite(redLed, (int)r_intensity);
-        analogWrite(greenLed, (int)g_intensity);
-        lastBreatheUpdate = millis();
+        binLog.log(LOG_GUESS_LATENCY, guessLatency.percentile(0.50), guessLatency.percentile(0.95),
+                   guessLatency.percentile(0.99), guessLatency.count());
     }
 }
 
+// Milliseconds until the current state, a retransmission or a dump needs loop() again
+uint32_t nextTimeout()
+{
+    uint32_t now = millis();
+    uint32_t timeout = retransmitter.nextPollIn(now);
+    if (recorder.dumpInProgress())
+    {
+        timeout = min(timeout, dumpPeriod);
+    }
+    switch (state)
+    {
+    case States::pairing:
+        timeout = min(timeout, timeUntil(lastAnnounce, announceDelay, now));
+        break;
+    case States::ready:
+        timeout = min(timeout, breather.nextUpdateIn(now));
+        break;
+    case States::starting:
+    {
+        // Wake up in the millisecond before the start, loop() waits for the rest
+        int32_t remaining = startAt - micros();
+        timeout = min(timeout, remaining > 0 ? (uint32_t)remaining / 1000 : 0);
+        break;
+    }
+    case States::guessed:
+        timeout = min(timeout, timeUntil(lastStateUpdate, verdictTimeout, now));
+        break;
+    case States::correct:
+    case States::wrong:
+        timeout = min(timeout, timeUntil(lastStateUpdate, feedbackDuration, now));
+        break;
+#ifdef BENCHMARK_MODE
+    case States::playing:
+        timeout = min(timeout, feedbackDuration); // Retry a guess the retransmitter had no room for
+        break;
+#endif
+    case States::won:
+        timeout = min(timeout, 1000 - now % 1000); // Next blink
+        timeout = min(timeout, timeUntil(lastStateUpdate, 10000, now));
+        break;
+    case States::lost:
+        timeout = min(timeout, timeUntil(lastStateUpdate, 10000, now));
+        break;
+    default:
+        break;
+    }
+    return timeout;
+}
+
 void loop()
 {
+    // Sleep until a button press, a frame, a command or the next timer, unless the last pass changed state
+    events.wait(state == previousState ? nextTimeout() : 0);
+    previousState = state;
+
+    if (events.take(EVENT_FRAME))
+    {
+        processFrames();
+#ifdef BENCHMARK_MODE
+        reportRoundTrips();
+#endif
+    }
+    serviceRetransmissions();
+
+    if (events.take(EVENT_SERIAL))
+    {
+        readCommands();
+    }
+    recorder.continueDump(binLog, dumpReserve);
+
     switch (state)
     {
+    case States::pairing:
+        if (paired)
+        {
+            state = States::ready;
+            break;
+        }
+        if (millis() - lastAnnounce >= announceDelay)
+        {
+            uint8_t frame[frameHeaderLength];
+            if (esp_now_send(broadcastMacAddress, frame, encodeBare(frame, FRAME_ANNOUNCE)) == ESP_OK)
+            {
+                retransmitter.sentUntracked();
+            }
+            lastAnnounce = millis();
+            announceDelay = announcePeriod + remoteRandom.below(announceJitter);
+        }
+        break;
+
     case States::ready:
-        locked = false;
-        breatheLeds();
-        if (startSignal)
+        if (!breather.isBreathing())
         {
-            Serial.println("The game starts !");
-            startSignal = false;
-            state = States::playing;
-            lastStateUpdate = millis();
+            breather.start(millis());
+        }
+        events.take(EVENT_FADE_END);
+        breather.update(millis());
+        if (!(signals & SIGNAL_GAME_START))
+        {
+            // The end of a game this remote did not take part in
+            signals &= ~SIGNAL_GAME_OVER;
+        }
+        if (signals & SIGNAL_GAME_START)
+        {
+            breather.stop();
+            signals &= ~SIGNAL_GAME_START;
+            state = States::starting;
         }
         break;
 
+    case States::starting:
+    {
+        int32_t remaining = startAt - micros();
+        if (remaining >= 1000)
+        {
+            break;
+        }
+        // Every remote enters the game at the instant picked by the manager
+        if (remaining > 0)
+        {
+            delayMicroseconds(remaining);
+        }
+        playStartedAt = micros();
+        // Presses from before the game do not count
+        buttons.drain([](const ButtonEvent &) {});
+        binLog.log(LOG_GAME_STARTED);
+        state = States::playing;
+        lastStateUpdate = millis();
+        break;
+    }
+
     case States::playing:
-        locked = false;
-        for (int i = 0; i < buttonsCount; ++i)
+        // A verdict arriving now answers a guess that was given up on; only the end of the game matters
+        signals &= ~(SIGNAL_GOOD_GUESS | SIGNAL_WRONG_GUESS);
+        if (signals & SIGNAL_GAME_WON)
+        {
+            signals &= ~SIGNAL_GAME_WON;
+            binLog.log(LOG_GAME_WON);
+            logGuessLatency();
+            state = States::won;
+            lastStateUpdate = millis();
+            break;
+        }
+        if (signals & SIGNAL_GAME_OVER)
+        {
+            signals &= ~SIGNAL_GAME_OVER;
+            binLog.log(LOG_GAME_LOST);
+            logGuessLatency();
+            state = States::lost;
+            lastStateUpdate = millis();
+            break;
+        }
+        // The next game began: the end of this one never made it here
+        if (signals & SIGNAL_GAME_START)
+        {
+            signals &= ~SIGNAL_GAME_START;
+            binLog.log(LOG_GAME_LOST);
+            logGuessLatency();
+            state = States::starting;
+            break;
+        }
+        events.take(EVENT_BUTTON);
+        guessNextPress();
+#ifdef BENCHMARK_MODE
+        if (state == States::playing)
         {
-            if (buttonPressed[i])
+            int button = remoteRandom.below(buttonsCount);
+            if (sendButtonPress(button, esp_timer_get_time()))
             {
-                buttonPressed[i] = false;
-                bool sendSuccess = sendButtonPress(i);
-                if (sendSuccess)
-                {
-                    Serial.print("Sent pressed signal for button ");
-                    Serial.println(i);
-                    state = States::guessed;
-                    lastStateUpdate = millis();
-                }
+                lastStateUpdate = millis();
             }
         }
+#endif
         break;
 
     case States::guessed:
-        if (wonSignal)
+        if (signals & SIGNAL_GAME_WON)
         {
-            wonSignal = false;
-            Serial.println("Game won !");
+            signals &= ~SIGNAL_GAME_WON;
+            binLog.log(LOG_GAME_WON);
+            logGuessLatency();
             state = States::won;
             lastStateUpdate = millis();
-            locked = true;
         }
-        else if (rightGuess)
+        else if (signals & SIGNAL_GAME_OVER)
         {
-            rightGuess = false;
-            Serial.println("Right guess !");
+            signals &= ~SIGNAL_GAME_OVER;
+            binLog.log(LOG_GAME_LOST);
+            logGuessLatency();
+            state = States::lost;
+            lastStateUpdate = millis();
+        }
+        else if (signals & SIGNAL_GOOD_GUESS)
+        {
+            signals &= ~SIGNAL_GOOD_GUESS;
+            binLog.log(LOG_RIGHT_GUESS);
             state = States::correct;
             lastStateUpdate = millis();
-            locked = true;
         }
-        else if (wrongGuess)
+        else if (signals & SIGNAL_WRONG_GUESS)
         {
-            wrongGuess = false;
-            Serial.println("Wrong guess !");
+            signals &= ~SIGNAL_WRONG_GUESS;
+            binLog.log(LOG_WRONG_GUESS);
             state = States::wrong;
             lastStateUpdate = millis();
-            locked = true;
+        }
+        else if (signals & SIGNAL_GAME_START)
+        {
+            // Left to playing, which moves on to the next game
+            state = States::playing;
+        }
+        else if (millis() - lastStateUpdate > verdictTimeout)
+        {
+            binLog.log(LOG_VERDICT_TIMEOUT);
+            state = States::playing;
+            lastStateUpdate = millis();
         }
         break;
 
     case States::correct:
         digitalWrite(greenLed, HIGH);
-        if (millis() - lastStateUpdate > 2000)
+        if (millis() - lastStateUpdate > feedbackDuration)
         {
             state = States::playing;
             lastStateUpdate = millis();
             digitalWrite(greenLed, LOW);
-            locked = false;
         }
         break;
         
     case States::wrong:
         digitalWrite(redLed, HIGH);
-        if (millis() - lastStateUpdate > 2000)
+        if (millis() - lastStateUpdate > feedbackDuration)
         {
             state = States::playing;
             lastStateUpdate = millis();
             digitalWrite(redLed, LOW);
-            locked = false;
         }
         break;
     
@@ -289,11 +785,20 @@ void loop()
         digitalWrite(greenLed, millis() % 2000 < 1000 ? HIGH : LOW);
         if (millis() - lastStateUpdate > 10000)
         {
-            Serial.println("Waiting for a new game start signal.");
+            binLog.log(LOG_WAITING_FOR_GAME);
             state = States::ready;
             digitalWrite(greenLed, LOW);
             digitalWrite(redLed, LOW);
-            locked = false;
+        }
+        break;
+
+    case States::lost:
+        digitalWrite(redLed, HIGH);
+        if (millis() - lastStateUpdate > 10000)
+        {
+            binLog.log(LOG_WAITING_FOR_GAME);
+            state = States::ready;
+            digitalWrite(redLed, LOW);
         }
         break;
     }
@@ -0,0 +1,229 @@
+/*******************************************************************************
+Deferred binary logging.
+
+log() stores a fixed-size record (timestamp, event id and up to four integer
+arguments) in a bounded lock-free ring and returns: no formatting, no
+blocking on the UART, so it is safe from callbacks, ISRs and the game loop
+alike. Any number of contexts may log; slots are claimed with a
+compare-and-swap on the enqueue index and published through a per-slot
+sequence number. Records logged while the ring is full are dropped and
+counted.
+
+A low-priority task writes each record as a CRC-checked frame (see
+BinLogFormat.h), then reports how many records were dropped since its last
+pass. It sleeps on a task notification while the ring is empty, so an idle
+node is not woken up for it: the first record logged wakes it, and it waits
+periodMs for the records that follow before writing them all. Before the
+records, at most once a second, it also writes one stamped right before it
+goes out, which lets the host tell the node's clock from the buffering
+delay. Text printed with Serial around
+the frames still reaches the monitor; BinLogDecoder.h separates the two.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "BinLogFormat.h"
+#include "LogEvents.h"
+
+template <size_t Capacity>
+class BinLog
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Writes encoded frames to the serial port, e.g. a wrapper around Serial.write()
+    typedef size_t (*Writer)(const uint8_t *data, size_t len);
+
+    BinLog()
+    {
+        for (size_t i = 0; i < Capacity; ++i)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Start the task writing the records out every periodMs, on the given core or on either
+    bool begin(Writer writer, uint32_t periodMs = 50, BaseType_t core = tskNO_AFFINITY)
+    {
+        this->writer = writer;
+        this->periodMs = periodMs;
+        return xTaskCreatePinnedToCore(flushTask, "binlog", 2048, this, tskIDLE_PRIORITY, &task, core) == pdPASS;
+    }
+
+    // Record an event with up to maxLogArgs integer arguments. Returns false if the ring was full.
+    template <typename... Args>
+    bool log(uint16_t id, Args... args)
+    {
+        static_assert(sizeof...(Args) <= maxLogArgs, "Too many arguments for one log record");
+        const int32_t values[] = {static_cast<int32_t>(args)..., 0};
+        return push(id, values, sizeof...(Args));
+    }
+
+    // Write out every queued record. Runs in the flush task; call it directly only from that
+    // task's priority or when it cannot run anymore, e.g. right before a restart.
+    void flush()
+    {
+        uint8_t frame[maxLogFrameLength];
+        LogRecord record;
+        uint32_t now = esp_timer_get_time();
+        if (pending() && now - lastClockSync >= clockSyncPeriod)
+        {
+            record = {now, LOG_CLOCK_SYNC, 0, {}};
+            writer(frame, encodeLogFrame(frame, record));
+            lastClockSync = now;
+        }
+
+        while (pop(record))
+        {
+            writer(frame, encodeLogFrame(frame, record));
+        }
+
+        uint32_t drops = dropCount.load(std::memory_order_relaxed);
+        if (drops != reportedDrops)
+        {
+            record = {(uint32_t)esp_timer_get_time(), LOG_RECORDS_DROPPED, 1, {(int32_t)(drops - reportedDrops)}};
+            writer(frame, encodeLogFrame(frame, record));
+            reportedDrops = drops;
+        }
+    }
+
+    // Whether count more records fit in the ring right now. Slots are freed in order,
+    // so the last of them being free is enough. Lets a bulk writer, such as a dump of
+    // stored data, wait for the flush task instead of losing records.
+    bool hasRoom(size_t count) const
+    {
+        if (count == 0)
+            return true;
+        if (count > Capacity)
+            return false;
+        uint32_t position = enqueuePosition.load(std::memory_order_relaxed) + count - 1;
+        return cells[position & mask].sequence.load(std::memory_order_acquire) == position;
+    }
+
+    // Records rejected because the ring was full, since startup
+    uint32_t dropped() const
+    {
+        return dropCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const uint32_t mask = Capacity - 1;
+    static const uint32_t clockSyncPeriod = 1000000;
+
+    // A slot is free for the producer claiming position p when its sequence is p,
+    // and holds a record for the consumer at position p when it is p + 1
+    struct Cell
+    {
+        std::atomic<uint32_t> sequence;
+        LogRecord record;
+    };
+
+    bool push(uint16_t id, const int32_t *values, uint8_t count)
+    {
+        uint32_t timestamp = esp_timer_get_time();
+        uint32_t position = enqueuePosition.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;)
+        {
+            cell = &cells[position & mask];
+            int32_t lag = (int32_t)(cell->sequence.load(std::memory_order_acquire) - position);
+            if (lag == 0)
+            {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (lag < 0)
+            {
+                // The consumer has not freed this slot yet: the ring is full
+                dropCount.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                // Another producer claimed this position first
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->record.timestamp = timestamp;
+        cell->record.id = id;
+        cell->record.argCount = count;
+        for (uint8_t i = 0; i < count; ++i)
+        {
+            cell->record.args[i] = values[i];
+        }
+        cell->sequence.store(position + 1, std::memory_order_release);
+
+        // The first record after the ring went empty wakes the flush task
+        if (sleeping.exchange(false, std::memory_order_seq_cst) && task)
+        {
+            if (xPortInIsrContext())
+            {
+                BaseType_t woken = pdFALSE;
+                xTaskNotifyFromISR(task, 0, eNoAction, &woken);
+                if (woken)
+                    portYIELD_FROM_ISR();
+            }
+            else
+            {
+                xTaskNotify(task, 0, eNoAction);
+            }
+        }
+        return true;
+    }
+
+    // Whether a record is waiting for the flush task
+    bool pending() const
+    {
+        return cells[dequeuePosition & mask].sequence.load(std::memory_order_acquire) == dequeuePosition + 1;
+    }
+
+    bool pop(LogRecord &record)
+    {
+        Cell &cell = cells[dequeuePosition & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+            return false;
+
+        record = cell.record;
+        cell.sequence.store(dequeuePosition + Capacity, std::memory_order_release);
+        dequeuePosition++;
+        return true;
+    }
+
+    static void flushTask(void *arg)
+    {
+        BinLog *log = static_cast<BinLog *>(arg);
+        for (;;)
+        {
+            log->flush();
+
+            // A record published after this check finds sleeping set and notifies,
+            // which the wait then returns on at once
+            log->sleeping.store(true, std::memory_order_seq_cst);
+            if (!log->pending())
+                xTaskNotifyWait(0, UINT32_MAX, nullptr, portMAX_DELAY);
+            log->sleeping.store(false, std::memory_order_relaxed);
+            vTaskDelay(pdMS_TO_TICKS(log->periodMs));
+        }
+    }
+
+    Cell cells[Capacity];
+    std::atomic<uint32_t> enqueuePosition{0};
+    std::atomic<uint32_t> dropCount{0};
+    uint32_t dequeuePosition = 0;
+    uint32_t reportedDrops = 0;
+    uint32_t lastClockSync = 0;
+    Writer writer = nullptr;
+    uint32_t periodMs = 50;
+    TaskHandle_t task = nullptr;
+    std::atomic<bool> sleeping{false}; // The flush task waits for a notification
+};
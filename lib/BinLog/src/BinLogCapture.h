@@ -0,0 +1,99 @@
+/*******************************************************************************
+Capture files of a serial stream, for the host tools and the simulator.
+
+A capture keeps the raw bytes read from a node together with the host time
+each chunk arrived at, which is what clock alignment needs. It starts with
+the 8-byte magic "BLCAP1\n\0", followed by chunks:
+  u64 host time in microseconds, u32 length, then length bytes
+All integers are little endian. Not meant for the firmwares.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+const char captureMagic[8] = {'B', 'L', 'C', 'A', 'P', '1', '\n', '\0'};
+
+class CaptureWriter
+{
+public:
+    ~CaptureWriter()
+    {
+        close();
+    }
+
+    bool open(const char *path)
+    {
+        file = fopen(path, "wb");
+        return file && fwrite(captureMagic, 1, sizeof(captureMagic), file) == sizeof(captureMagic);
+    }
+
+    void write(uint64_t hostTime, const uint8_t *data, uint32_t len)
+    {
+        if (!file)
+            return;
+        uint8_t header[12];
+        for (int i = 0; i < 8; ++i)
+        {
+            header[i] = hostTime >> (8 * i);
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            header[8 + i] = len >> (8 * i);
+        }
+        fwrite(header, 1, sizeof(header), file);
+        fwrite(data, 1, len, file);
+    }
+
+    void close()
+    {
+        if (file)
+            fclose(file);
+        file = nullptr;
+    }
+
+private:
+    FILE *file = nullptr;
+};
+
+class CaptureReader
+{
+public:
+    ~CaptureReader()
+    {
+        if (file)
+            fclose(file);
+    }
+
+    // Returns false if the file cannot be read or is not a capture
+    bool open(const char *path)
+    {
+        file = fopen(path, "rb");
+        char magic[sizeof(captureMagic)];
+        return file && fread(magic, 1, sizeof(magic), file) == sizeof(magic) && !memcmp(magic, captureMagic, sizeof(magic));
+    }
+
+    // Read the next chunk. Returns false at the end of the file, or on a truncated chunk.
+    bool next(uint64_t &hostTime, std::vector<uint8_t> &data)
+    {
+        uint8_t header[12];
+        if (fread(header, 1, sizeof(header), file) != sizeof(header))
+            return false;
+        hostTime = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            hostTime |= (uint64_t)header[i] << (8 * i);
+        }
+        uint32_t len = header[8] | (header[9] << 8) | (header[10] << 16) | ((uint32_t)header[11] << 24);
+        data.resize(len);
+        return fread(data.data(), 1, len, file) == len;
+    }
+
+private:
+    FILE *file = nullptr;
+};
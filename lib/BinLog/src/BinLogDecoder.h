@@ -0,0 +1,136 @@
+/*******************************************************************************
+Host-side decoder for a serial stream mixing text lines and BinLog frames,
+used by the simulator and the host tools. Not meant for the firmwares.
+
+Bytes are fed in as they arrive, in chunks of any size. Text is handed out
+line by line; a frame is handed out once its CRC checks. A frame with a bad
+CRC or length is treated as noise: its first byte is dropped and the rest is
+scanned again, so the decoder resynchronizes on the next valid frame.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "BinLogFormat.h"
+#include "LogEvents.h"
+
+class BinLogDecoder
+{
+public:
+    std::function<void(const std::string &line)> onText;
+    std::function<void(const LogRecord &record)> onRecord;
+
+    void feed(const uint8_t *data, size_t len)
+    {
+        for (size_t i = 0; i < len; ++i)
+        {
+            feed(data[i]);
+        }
+    }
+
+    void feed(uint8_t byte)
+    {
+        if (pending.empty())
+        {
+            if (byte == logSync0)
+                pending.push_back(byte);
+            else
+                text(byte);
+            return;
+        }
+
+        pending.push_back(byte);
+        if (pending.size() == 2)
+        {
+            if (byte != logSync1)
+                resync();
+            return;
+        }
+        if (pending.size() == 3)
+        {
+            if (byte < logBodyHeaderLength || byte > maxLogBodyLength)
+                resync();
+            return;
+        }
+
+        size_t bodyLength = pending[2];
+        if (pending.size() < bodyLength + 5)
+            return;
+
+        uint16_t crc = pending[bodyLength + 3] | (pending[bodyLength + 4] << 8);
+        LogRecord record;
+        if (crc != logCrc(pending.data() + 2, bodyLength + 1) || !decodeLogBody(pending.data() + 3, bodyLength, record))
+        {
+            badFrames++;
+            resync();
+            return;
+        }
+        pending.clear();
+        records++;
+        if (onRecord)
+            onRecord(record);
+    }
+
+    // Frames dropped for a bad CRC or layout
+    uint32_t badFrames = 0;
+    uint32_t records = 0;
+
+private:
+    void text(uint8_t byte)
+    {
+        if (byte == '\n')
+        {
+            if (onText)
+                onText(line);
+            line.clear();
+        }
+        else if (byte != '\r')
+        {
+            line += (char)byte;
+        }
+    }
+
+    // The bytes taken for a frame were not one: drop the sync byte and scan the others again
+    void resync()
+    {
+        std::vector<uint8_t> bytes;
+        bytes.swap(pending);
+        feed(bytes.data() + 1, bytes.size() - 1);
+    }
+
+    std::vector<uint8_t> pending;
+    std::string line;
+};
+
+// Render a record with the format of its event
+inline std::string formatLogRecord(const LogRecord &record)
+{
+    char text[160];
+    const LogEventInfo *info = findLogEvent(record.id);
+    if (!info)
+    {
+        int len = snprintf(text, sizeof(text), "Unknown event %u", record.id);
+        for (uint8_t i = 0; i < record.argCount && len < (int)sizeof(text); ++i)
+        {
+            len += snprintf(text + len, sizeof(text) - len, " %d", (int)record.args[i]);
+        }
+        return text;
+    }
+
+    int32_t args[maxLogArgs] = {};
+    for (uint8_t i = 0; i < record.argCount; ++i)
+    {
+        args[i] = record.args[i];
+    }
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+    snprintf(text, sizeof(text), info->format, (int)args[0], (int)args[1], (int)args[2], (int)args[3]);
+#pragma GCC diagnostic pop
+    return text;
+}
@@ -0,0 +1,100 @@
+/*******************************************************************************
+Wire format of BinLog records.
+
+Each record is written to serial as a frame:
+  bytes 0-1  sync bytes 0xA5 0x5A
+  byte 2     length n of the body
+  n bytes    body: timestamp (u32, microseconds), event id (u16),
+             argument count (u8), then each argument (i32)
+  2 bytes    CRC-16/CCITT-FALSE of the length byte and the body
+All integers are little endian. The sync bytes are not valid text, so frames
+can be told apart from the plain text lines printed around them.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+const uint8_t logSync0 = 0xA5;
+const uint8_t logSync1 = 0x5A;
+const uint8_t maxLogArgs = 4;
+const size_t logBodyHeaderLength = 7;
+const size_t maxLogBodyLength = logBodyHeaderLength + 4 * maxLogArgs;
+const size_t maxLogFrameLength = 3 + maxLogBodyLength + 2;
+
+struct LogRecord
+{
+    uint32_t timestamp;
+    uint16_t id;
+    uint8_t argCount;
+    int32_t args[maxLogArgs];
+};
+
+inline uint16_t logCrc(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; ++i)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Write the frame of a record into buffer, which must hold maxLogFrameLength bytes. Returns its length.
+inline size_t encodeLogFrame(uint8_t *buffer, const LogRecord &record)
+{
+    uint8_t argCount = record.argCount < maxLogArgs ? record.argCount : maxLogArgs;
+    uint8_t *body = buffer + 3;
+    body[0] = record.timestamp & 0xFF;
+    body[1] = (record.timestamp >> 8) & 0xFF;
+    body[2] = (record.timestamp >> 16) & 0xFF;
+    body[3] = record.timestamp >> 24;
+    body[4] = record.id & 0xFF;
+    body[5] = record.id >> 8;
+    body[6] = argCount;
+    for (uint8_t i = 0; i < argCount; ++i)
+    {
+        uint32_t value = record.args[i];
+        uint8_t *arg = body + logBodyHeaderLength + 4 * i;
+        arg[0] = value & 0xFF;
+        arg[1] = (value >> 8) & 0xFF;
+        arg[2] = (value >> 16) & 0xFF;
+        arg[3] = value >> 24;
+    }
+
+    size_t bodyLength = logBodyHeaderLength + 4 * argCount;
+    buffer[0] = logSync0;
+    buffer[1] = logSync1;
+    buffer[2] = bodyLength;
+    uint16_t crc = logCrc(buffer + 2, bodyLength + 1);
+    buffer[3 + bodyLength] = crc & 0xFF;
+    buffer[4 + bodyLength] = crc >> 8;
+    return bodyLength + 5;
+}
+
+// Parse a frame body whose CRC was checked. Returns false if it is malformed.
+inline bool decodeLogBody(const uint8_t *body, size_t len, LogRecord &record)
+{
+    if (len < logBodyHeaderLength)
+        return false;
+
+    record.timestamp = body[0] | (body[1] << 8) | (body[2] << 16) | ((uint32_t)body[3] << 24);
+    record.id = body[4] | (body[5] << 8);
+    record.argCount = body[6];
+    if (record.argCount > maxLogArgs || len != logBodyHeaderLength + 4 * record.argCount)
+        return false;
+
+    for (uint8_t i = 0; i < record.argCount; ++i)
+    {
+        const uint8_t *arg = body + logBodyHeaderLength + 4 * i;
+        record.args[i] = (int32_t)(arg[0] | (arg[1] << 8) | (arg[2] << 16) | ((uint32_t)arg[3] << 24));
+    }
+    return true;
+}
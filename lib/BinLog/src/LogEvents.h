@@ -0,0 +1,115 @@
+/*******************************************************************************
+Events logged by the firmwares through BinLog, shared with the tools that
+decode them. Ids are part of the log format: append new events, never reuse
+or renumber old ones.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum LogEvent : uint16_t
+{
+    LOG_RECORDS_DROPPED = 0, // Written by BinLog itself when its ring overflowed
+    LOG_CLOCK_SYNC = 2,      // Written by BinLog itself right before writing, for the host to align clocks
+
+    // Both nodes
+    LOG_SEND_STATUS = 1,
+    LOG_INPUT_CHUNK = 3, // Offset, then 12 bytes of the input recording as 3 words
+    LOG_INPUT_END = 4,
+
+    // Game manager
+    LOG_SEQUENCE_GENERATED = 16,
+    LOG_LONG_PRESS = 17,
+    LOG_SHORT_PRESS = 18,
+    LOG_DIFFICULTY_CHANGED = 19,
+    LOG_GAME_START_SENT = 20,
+    LOG_GUESS_RECEIVED = 21,
+    LOG_GUESSES_DROPPED = 22,
+    LOG_REMOTE_WON = 23,
+    LOG_UNKNOWN_PEER = 24,
+    LOG_REMOTE_PAIRED = 25,
+    LOG_PAIRING_REFUSED = 26,
+    LOG_SETTINGS_SAVED = 27,
+    LOG_HIGH_SCORE = 28,
+    LOG_HISTORY_RECORD = 29, // Stats packed as difficulty | wrong guesses << 8 | guesses << 16
+    LOG_HISTORY_END = 30,
+    LOG_HISTORY_FAILED = 31,
+
+    // Remote
+    LOG_SEND_ABANDONED = 32,
+    LOG_GUESS_NOT_SENT = 33,
+    LOG_GUESS_SENT = 34,
+    LOG_GAME_STARTED = 35,
+    LOG_RIGHT_GUESS = 36,
+    LOG_WRONG_GUESS = 37,
+    LOG_GAME_WON = 38,
+    LOG_VERDICT_TIMEOUT = 39,
+    LOG_WAITING_FOR_GAME = 40,
+    LOG_GAME_LOST = 41,
+    LOG_PAIRED = 42,
+    LOG_GUESS_LATENCY = 43,
+
+    // Game manager, continued
+    LOG_CPU_FREQUENCY = 44,
+    LOG_CPU_TIME = 45,
+};
+
+// How to print an event: a printf format taking its arguments as ints
+struct LogEventInfo
+{
+    uint16_t id;
+    const char *name;
+    const char *format;
+};
+
+const LogEventInfo logEvents[] = {
+    {LOG_RECORDS_DROPPED, "records_dropped", "%d log records dropped"},
+    {LOG_CLOCK_SYNC, "clock_sync", "Clock sync"},
+    {LOG_SEND_STATUS, "send_status", "Packet send status: %d (0 = success)"},
+    {LOG_INPUT_CHUNK, "input_chunk", "Inputs at %d: %08x %08x %08x"},
+    {LOG_INPUT_END, "input_end", "Input recording dumped, %d bytes, %d inputs dropped"},
+    {LOG_SEQUENCE_GENERATED, "sequence_generated", "Generated random sequences of %d values for %d remotes"},
+    {LOG_LONG_PRESS, "long_press", "Long press detected! (%d ms)"},
+    {LOG_SHORT_PRESS, "short_press", "Short press detected! (%d ms)"},
+    {LOG_DIFFICULTY_CHANGED, "difficulty_changed", "New difficulty: %d"},
+    {LOG_GAME_START_SENT, "game_start_sent", "Start signal sent for session %d, status 0x%x"},
+    {LOG_GUESS_RECEIVED, "guess_received", "Received guess: %d (queued for %d us) from remote %04x"},
+    {LOG_GUESSES_DROPPED, "guesses_dropped", "Guesses dropped on a full queue so far: %d"},
+    {LOG_REMOTE_WON, "remote_won", "Remote %04x won, %d games so far"},
+    {LOG_UNKNOWN_PEER, "unknown_peer", "Frame from unknown peer %04x ignored"},
+    {LOG_REMOTE_PAIRED, "remote_paired", "Paired remote %04x, %d remotes"},
+    {LOG_PAIRING_REFUSED, "pairing_refused", "Remote %04x refused, no peer slot left (status 0x%x)"},
+    {LOG_SETTINGS_SAVED, "settings_saved", "Saved %d settings to NVS"},
+    {LOG_HIGH_SCORE, "high_score", "Game %d is high score #%d"},
+    {LOG_HISTORY_RECORD, "history_record", "History: game %d, %d ms, stats 0x%08x, remote %04x"},
+    {LOG_HISTORY_END, "history_end", "History export done, %d games"},
+    {LOG_HISTORY_FAILED, "history_failed", "Failed to store the game in the history (error 0x%x)"},
+    {LOG_SEND_ABANDONED, "send_abandoned", "Failed to send frame %d after every attempt"},
+    {LOG_GUESS_NOT_SENT, "guess_not_sent", "Failed to send button press."},
+    {LOG_GUESS_SENT, "guess_sent", "Sent pressed signal for button %d, %d us after the press"},
+    {LOG_GAME_STARTED, "game_started", "The game starts !"},
+    {LOG_RIGHT_GUESS, "right_guess", "Right guess !"},
+    {LOG_WRONG_GUESS, "wrong_guess", "Wrong guess !"},
+    {LOG_GAME_WON, "game_won", "Game won !"},
+    {LOG_VERDICT_TIMEOUT, "verdict_timeout", "No verdict received, guess again."},
+    {LOG_WAITING_FOR_GAME, "waiting_for_game", "Waiting for a new game start signal."},
+    {LOG_GAME_LOST, "game_lost", "Another remote won the game."},
+    {LOG_PAIRED, "paired", "Paired with manager %04x"},
+    {LOG_GUESS_LATENCY, "guess_latency", "Guesses on air after the press: p50 %d us, p95 %d us, p99 %d us over %d"},
+    {LOG_CPU_FREQUENCY, "cpu_frequency", "CPU at %d MHz, switched in %d us"},
+    {LOG_CPU_TIME, "cpu_time", "CPU time: %d ms at %d MHz, %d ms scaled down, %d switches"},
+};
+
+inline const LogEventInfo *findLogEvent(uint16_t id)
+{
+    for (const LogEventInfo &info : logEvents)
+    {
+        if (info.id == id)
+            return &info;
+    }
+    return nullptr;
+}
@@ -0,0 +1,265 @@
+/*******************************************************************************
+Button debouncing on a periodic timer.
+
+A debounce in the ISR can only ignore edges for a while after the first one:
+the bounce on release gets through as a new press, and how long a button is
+held is left to whoever reads the pin next. Here the ISR only wakes an
+esp_timer, which samples every button at a fixed period, and a button
+changes state once it read the same new level debounceSamples times in a
+row. The samples are integrated with vertical counters: bit i of two words
+is the two-bit counter of button i, so every button is stepped by the same
+few bitwise operations, whatever their number, up to 32.
+
+Each change is turned into events, queued for loop() with the time of the
+edge the ISR saw first, as ButtonEdges stamped it: press and release, then short press on a release
+before longPressMs, or long press as soon as the button has been held that
+long, followed by a repeat every repeatPeriodMs while it stays down. A
+change is reported within debounceMs of the last bounce, plus the delay of
+the timer task; latencyUs() gives the bound.
+
+The timer stops once every button has settled and none is being timed, so
+an idle board is not woken up by it; the next edge starts it again.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <ButtonEdges.h>
+#include <SpscQueue.h>
+
+enum ButtonEventKind : uint8_t
+{
+    BUTTON_PRESS = 1,
+    BUTTON_RELEASE = 2,
+    BUTTON_SHORT_PRESS = 3, // Released before the long press time, right after its BUTTON_RELEASE
+    BUTTON_LONG_PRESS = 4,  // Held for the long press time, while still down
+    BUTTON_REPEAT = 5,      // Still down, every repeat period after the long press
+};
+
+struct ButtonEvent
+{
+    uint32_t time;  // esp_timer_get_time() of the edge, or of the sample that timed a hold, in us
+    uint32_t held;  // Microseconds the button had been down at that time, 0 for a press
+    uint8_t button; // Index in the pins of the debouncer
+    uint8_t kind;   // ButtonEventKind
+};
+
+struct DebounceConfig
+{
+    uint32_t debounceMs;         // How long a new level must hold before it counts
+    uint32_t longPressMs = 0;    // 0: no long presses, every release is a short press
+    uint32_t repeatPeriodMs = 0; // 0: no repeats
+};
+
+template <size_t Buttons, size_t QueueCapacity = 16>
+class ButtonDebouncer
+{
+    static_assert(Buttons > 0 && Buttons <= 32, "One bit per button in the counters");
+
+public:
+    // Called on the timer task once events are queued, e.g. to post an event to loop()
+    typedef void (*Notify)();
+
+    static const uint32_t debounceSamples = 4; // The vertical counters are two bits wide
+
+    // Buttons are active low, as with INPUT_PULLUP
+    ButtonDebouncer(const uint8_t (&pins)[Buttons], const DebounceConfig &config, Notify notify)
+        : pins(pins), config(config), notify(notify),
+          samplePeriodUs(config.debounceMs * 1000 / debounceSamples > 0 ? config.debounceMs * 1000 / debounceSamples : 1)
+    {
+    }
+
+    // Create the timer and take the levels of the buttons as they are. A button already
+    // held only reports its release, without a short or long press.
+    bool begin()
+    {
+        esp_timer_create_args_t args = {};
+        args.callback = onSample;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "debounce";
+        if (esp_timer_create(&args, &timer) != ESP_OK)
+            return false;
+
+        state = readPressed();
+        quiet = state;
+        for (uint32_t bits = quiet; bits; bits &= bits - 1)
+        {
+            pressedAt[__builtin_ctz(bits)] = esp_timer_get_time();
+        }
+        return true;
+    }
+
+    // Call from the ISR of every button, on both edges. Always inlined so it lands in the ISR's IRAM section.
+    inline __attribute__((always_inline)) void edge(uint8_t button)
+    {
+        // The first edge of a burst stamps the change the samples will confirm, or not
+        edges.stamp(button);
+        if (!sampling.exchange(true, std::memory_order_relaxed))
+            esp_timer_start_periodic(timer, samplePeriodUs);
+    }
+
+    // Consumer side, usually loop()
+    bool pop(ButtonEvent &event)
+    {
+        return events.pop(event);
+    }
+
+    template <typename Consumer>
+    size_t drain(Consumer consume)
+    {
+        return events.drain(consume);
+    }
+
+    // Debounced state of a button
+    bool pressed(uint8_t button) const
+    {
+        return state & (1u << button);
+    }
+
+    // Longest time from the last bounce of a change to its event being queued, in us
+    uint32_t latencyUs() const
+    {
+        return samplePeriodUs * debounceSamples;
+    }
+
+    // Events lost because loop() did not keep up, since startup
+    uint32_t dropped() const
+    {
+        return events.dropped();
+    }
+
+private:
+    static void onSample(void *arg)
+    {
+        static_cast<ButtonDebouncer *>(arg)->sample();
+    }
+
+    uint32_t readPressed() const
+    {
+        uint32_t levels = 0;
+        for (size_t i = 0; i < Buttons; ++i)
+        {
+            if (digitalRead(pins[i]) == LOW)
+                levels |= 1u << i;
+        }
+        return levels;
+    }
+
+    void sample()
+    {
+        uint32_t now = esp_timer_get_time();
+
+        // Each counter counts the samples in a row differing from the debounced state, and
+        // goes back to 0 on a sample agreeing with it. Wrapping around to 0 means 4 in a row.
+        uint32_t delta = readPressed() ^ state;
+        count1 = (count1 ^ count0) & delta;
+        count0 = ~count0 & delta;
+        uint32_t toggled = delta & ~(count0 | count1);
+        state ^= toggled;
+
+        uint32_t stamped = edges.stamped();
+        bool queued = false;
+        for (uint32_t bits = toggled; bits; bits &= bits - 1)
+        {
+            uint8_t button = __builtin_ctz(bits);
+            queued |= changed(button, stamped & (1u << button) ? edges.time(button) : now);
+        }
+        for (uint32_t bits = timing; bits; bits &= bits - 1)
+        {
+            queued |= timeHold(__builtin_ctz(bits), now);
+        }
+
+        // A burst is over for the buttons whose counter is back to 0
+        edges.keep(count0 | count1);
+        if (queued && notify)
+            notify();
+
+        if ((count0 | count1) == 0 && timing == 0)
+        {
+            esp_timer_stop(timer);
+            sampling.store(false, std::memory_order_relaxed);
+            // An edge between the last sample and now did not start the timer
+            if (readPressed() != state && !sampling.exchange(true, std::memory_order_relaxed))
+                esp_timer_start_periodic(timer, samplePeriodUs);
+        }
+    }
+
+    bool changed(uint8_t button, uint32_t time)
+    {
+        uint32_t bit = 1u << button;
+        if (state & bit)
+        {
+            pressedAt[button] = time;
+            if (config.longPressMs > 0)
+            {
+                nextHoldEvent[button] = time + config.longPressMs * 1000;
+                timing |= bit;
+            }
+            return queue(BUTTON_PRESS, button, time);
+        }
+
+        timing &= ~bit;
+        bool queued = queue(BUTTON_RELEASE, button, time);
+        if (!((quiet | longPressed) & bit))
+            queued |= queue(BUTTON_SHORT_PRESS, button, time);
+        quiet &= ~bit;
+        longPressed &= ~bit;
+        return queued;
+    }
+
+    bool timeHold(uint8_t button, uint32_t now)
+    {
+        uint32_t bit = 1u << button;
+        if ((int32_t)(now - nextHoldEvent[button]) < 0)
+            return false;
+
+        bool first = !(longPressed & bit);
+        longPressed |= bit;
+        if (config.repeatPeriodMs > 0)
+            nextHoldEvent[button] += config.repeatPeriodMs * 1000;
+        else
+            timing &= ~bit;
+        return queue(first ? BUTTON_LONG_PRESS : BUTTON_REPEAT, button, now);
+    }
+
+    bool queue(uint8_t kind, uint8_t button, uint32_t time)
+    {
+        ButtonEvent event;
+        event.time = time;
+        event.held = kind == BUTTON_PRESS ? 0 : time - pressedAt[button];
+        event.button = button;
+        event.kind = kind;
+        return events.push(event);
+    }
+
+    const uint8_t (&pins)[Buttons];
+    const DebounceConfig config;
+    const Notify notify;
+    const uint32_t samplePeriodUs;
+    esp_timer_handle_t timer = nullptr;
+
+    // Written by the ISRs, cleared by the timer task
+    ButtonEdges<Buttons> edges;
+    std::atomic<bool> sampling{false};
+
+    // Timer task only: one bit per button
+    uint32_t state = 0;       // Debounced, 1 when pressed
+    uint32_t count0 = 0;      // Low bits of the vertical counters
+    uint32_t count1 = 0;      // High bits
+    uint32_t timing = 0;      // Held, with a long press or a repeat to come
+    uint32_t longPressed = 0; // Held past the long press time
+    uint32_t quiet = 0;       // Held since begin(), its release is not a press
+    uint32_t pressedAt[Buttons] = {};
+    uint32_t nextHoldEvent[Buttons] = {};
+
+    SpscQueue<ButtonEvent, QueueCapacity> events;
+};
@@ -0,0 +1,64 @@
+/*******************************************************************************
+Button edges timestamped in their interrupt.
+
+By the time anything but the ISR looks at a button, it can only read the pin:
+when the press began is lost, and with it how long the button was held or
+how long the guess waited. stamp() takes esp_timer_get_time() in the ISR, for
+the first edge of a burst only, as the bounces after it do not move the
+press. Whoever samples the buttons, ButtonDebouncer here, reads the stamps of
+the changes it confirms and clears them with keep() once a burst is over, so
+the next edge starts a new one.
+
+One bit per button in a word, up to 32 buttons. The ISRs only set bits and
+the sampling task only clears them, both with atomics; a stamp is published
+by setting its bit after writing the time.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <esp_timer.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+template <size_t Buttons>
+class ButtonEdges
+{
+    static_assert(Buttons > 0 && Buttons <= 32, "One bit per button");
+
+public:
+    // Call from the ISR of the button. Always inlined so it lands in the ISR's IRAM section.
+    inline __attribute__((always_inline)) void stamp(uint8_t button)
+    {
+        uint32_t bit = 1u << button;
+        if (!(bursts.load(std::memory_order_relaxed) & bit))
+        {
+            edgeAt[button] = esp_timer_get_time();
+            bursts.fetch_or(bit, std::memory_order_release);
+        }
+    }
+
+    // Buttons with a burst in progress, whose time() is the first edge
+    uint32_t stamped() const
+    {
+        return bursts.load(std::memory_order_acquire);
+    }
+
+    uint32_t time(uint8_t button) const
+    {
+        return edgeAt[button];
+    }
+
+    // End the bursts of every button but those given
+    void keep(uint32_t buttons)
+    {
+        bursts.fetch_and(buttons, std::memory_order_relaxed);
+    }
+
+private:
+    uint32_t edgeAt[Buttons] = {};
+    std::atomic<uint32_t> bursts{0};
+};
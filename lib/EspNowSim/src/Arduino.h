@@ -0,0 +1,121 @@
+/*******************************************************************************
+Host-side stand-in for the Arduino-ESP32 core. Every call is routed to the
+simulated node currently executing (see EspNowSim.h).
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#define IRAM_ATTR
+
+// Core of the task running loop(), as esp32-hal.h defines it in the Arduino-ESP32 build
+#define ARDUINO_RUNNING_CORE 1
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+typedef std::string String;
+
+using std::max;
+using std::min;
+
+// GPIO
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+// Time, 32 bits wide like on the ESP32 so wrap-around behaves the same
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// Random numbers
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+uint32_t getCpuFrequencyMhz();
+
+class HardwareSerial
+{
+public:
+    typedef std::function<void(void)> OnReceiveCb;
+
+    void begin(unsigned long baud);
+
+    // Input, sent with sim::Node::receiveSerial()
+    int available();
+    int read();
+    void onReceive(OnReceiveCb function, bool onlyOnTimeout = false);
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+
+    size_t print(const char *str);
+    size_t print(const String &str);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(long long value, int base = DEC);
+    size_t print(unsigned long long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println();
+    template <typename T>
+    size_t println(const T &value)
+    {
+        size_t n = print(value);
+        return n + println();
+    }
+    template <typename T>
+    size_t println(const T &value, int format)
+    {
+        size_t n = print(value, format);
+        return n + println();
+    }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+private:
+    size_t printNumber(unsigned long long value, int base, bool negative);
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    [[noreturn]] void restart();
+};
+
+extern EspClass ESP;
@@ -0,0 +1,783 @@
+/*******************************************************************************
+Implementation of the simulated nodes, radio bus and Arduino stand-ins.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#include "EspNowSim.h"
+
+#include <WiFi.h>
+#include <esp_random.h>
+
+#include <algorithm>
+#include <cstdarg>
+#include <random>
+
+namespace sim
+{
+    namespace
+    {
+        const MacAddress broadcastMac = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+        thread_local Node *currentNode = nullptr;
+        std::vector<Node *> nodes;
+        BusConfig config;
+        BusStats stats;
+        std::mt19937 rng(1);
+
+        Node *findNode(const MacAddress &mac)
+        {
+            for (Node *node : nodes)
+            {
+                if (node->mac == mac)
+                    return node;
+            }
+            return nullptr;
+        }
+
+        bool hasPeer(const Node &node, const MacAddress &mac)
+        {
+            return std::find(node.peers.begin(), node.peers.end(), mac) != node.peers.end();
+        }
+
+        MacAddress toMac(const uint8_t *mac)
+        {
+            MacAddress result;
+            std::copy(mac, mac + ESP_NOW_ETH_ALEN, result.begin());
+            return result;
+        }
+
+        void digest(uint64_t &hash, const void *data, size_t len)
+        {
+            for (size_t i = 0; i < len; ++i)
+            {
+                hash = (hash ^ static_cast<const uint8_t *>(data)[i]) * 0x100000001b3;
+            }
+        }
+
+        // Account for a frame the node sends in its output digest
+        void digestFrame(Node &node, const MacAddress &destination, const uint8_t *data, size_t len)
+        {
+            uint64_t time = now();
+            digest(node.outputDigest, &time, sizeof(time));
+            digest(node.outputDigest, destination.data(), destination.size());
+            digest(node.outputDigest, &len, sizeof(len));
+            digest(node.outputDigest, data, len);
+            node.framesSent++;
+        }
+
+        // Put one frame on the air: the receivers get it and the sender gets its status after the bus latency
+        void transmit(Node &sender, const MacAddress &destination, const uint8_t *data, size_t len)
+        {
+            uint64_t deliverAt = now() + config.latencyUs;
+            bool broadcast = destination == broadcastMac;
+            bool received = false;
+
+            stats.sent++;
+            for (Node *node : nodes)
+            {
+                if (node == &sender || !node->espNowInit)
+                    continue;
+                if (!broadcast && node->mac != destination)
+                    continue;
+
+                // Each receiver of a broadcast misses it on its own
+                if (std::bernoulli_distribution(config.lossRate)(rng))
+                {
+                    stats.lost++;
+                    continue;
+                }
+                if (!node->radioListening(deliverAt))
+                {
+                    stats.missedAsleep++;
+                    continue;
+                }
+
+                received = true;
+                stats.delivered++;
+                post(*node, {deliverAt, true, sender.mac, std::vector<uint8_t>(data, data + len), ESP_NOW_SEND_SUCCESS});
+            }
+
+            if (!broadcast && !received && !findNode(destination))
+                stats.undeliverable++;
+
+            // Broadcasts are never acknowledged at the MAC level, so they always report success
+            esp_now_send_status_t status = broadcast || received ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL;
+            post(sender, {deliverAt, false, destination, {}, status});
+        }
+    }
+
+    Node::Node(const char *name, const uint8_t (&mac)[ESP_NOW_ETH_ALEN], void (*setup)(), void (*loop)())
+        : name(name), mac(toMac(mac)), setupFn(setup), loopFn(loop)
+    {
+        std::fill(std::begin(pinLevels), std::end(pinLevels), HIGH);
+        std::fill(std::begin(powerDomains), std::end(powerDomains), ESP_PD_OPTION_AUTO);
+    }
+
+    bool Node::radioListening(uint64_t time) const
+    {
+        if (wifiPowerSave == WIFI_PS_NONE || radioWakeWindowMs >= radioWakeIntervalMs)
+            return true;
+        return time / 1000 % radioWakeIntervalMs < radioWakeWindowMs;
+    }
+
+    void Node::start()
+    {
+        wifiTask = spawn("wifi", this, [this]
+                         { runWifi(); }, WIFI_TASK_CORE_ID);
+        spawn("loop", this, [this]
+              { runLoop(); }, ARDUINO_RUNNING_CORE);
+        // The esp_timer task of ESP-IDF 4.4, under Arduino-ESP32 2.x, is pinned to the PRO CPU
+        timerTask = spawn("timers", this, [this]
+                          { runTimers(); }, 0);
+    }
+
+    void Node::runLoop()
+    {
+        setupFn();
+        for (;;)
+        {
+            uint64_t passStart = now();
+            loopFn();
+            loopPasses++;
+            sleepUntil(passStart + loopPeriodUs());
+        }
+    }
+
+    // Hand frames and send statuses to the firmware callbacks as their time comes
+    void Node::runWifi()
+    {
+        for (;;)
+        {
+            if (radioEvents.empty())
+            {
+                block(UINT64_MAX);
+                continue;
+            }
+            if (radioEvents.front().time > now())
+            {
+                block(radioEvents.front().time);
+                continue;
+            }
+
+            RadioEvent event = std::move(radioEvents.front());
+            radioEvents.pop_front();
+            if (event.received && recvCb)
+                recvCb(event.peer.data(), event.payload.data(), (int)event.payload.size());
+            else if (!event.received && sendCb)
+                sendCb(event.peer.data(), event.status);
+        }
+    }
+
+    void Node::setPin(uint8_t pin, uint8_t level)
+    {
+        uint8_t previousLevel = pinLevels[pin];
+        pinLevels[pin] = level;
+        if (previousLevel == level || !isrs[pin])
+            return;
+
+        bool rising = level == HIGH;
+        int mode = isrModes[pin];
+        if (mode == CHANGE || (mode == RISING && rising) || (mode == FALLING && !rising))
+        {
+            Context context(*this);
+            isrs[pin]();
+        }
+    }
+
+    Context::Context(Node &node) : previous(currentNode)
+    {
+        currentNode = &node;
+    }
+
+    Context::~Context()
+    {
+        currentNode = previous;
+    }
+
+    Node *current()
+    {
+        return currentNode;
+    }
+
+    void post(Node &node, RadioEvent event)
+    {
+        auto position = std::upper_bound(node.radioEvents.begin(), node.radioEvents.end(), event.time,
+                                         [](uint64_t time, const RadioEvent &other)
+                                         { return time < other.time; });
+        node.radioEvents.insert(position, std::move(event));
+        if (node.wifiTask)
+            wake(node.wifiTask);
+    }
+
+    void attach(Node &node)
+    {
+        nodes.push_back(&node);
+    }
+
+    BusConfig &busConfig()
+    {
+        return config;
+    }
+
+    const BusStats &busStats()
+    {
+        return stats;
+    }
+
+    void seed(uint32_t value)
+    {
+        rng.seed(value);
+    }
+
+    std::string formatMac(const uint8_t *mac)
+    {
+        char text[18];
+        snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        return text;
+    }
+
+    // Called by the ESP-NOW stand-in
+    esp_err_t send(Node &node, const uint8_t *peerAddr, const uint8_t *data, size_t len)
+    {
+        if (!node.espNowInit)
+            return ESP_ERR_ESPNOW_NOT_INIT;
+        if (!data || len == 0 || len > ESP_NOW_MAX_DATA_LEN)
+            return ESP_ERR_ESPNOW_ARG;
+
+        // A null address sends to every registered peer
+        std::vector<MacAddress> destinations;
+        if (peerAddr)
+        {
+            MacAddress destination = toMac(peerAddr);
+            if (!hasPeer(node, destination))
+                return ESP_ERR_ESPNOW_NOT_FOUND;
+            destinations.push_back(destination);
+        }
+        else
+        {
+            destinations = node.peers;
+        }
+
+        for (const MacAddress &destination : destinations)
+        {
+            digestFrame(node, destination, data, len);
+            if (!node.replaying)
+                transmit(node, destination, data, len);
+        }
+        return ESP_OK;
+    }
+
+    void Node::receiveSerial(const std::string &data)
+    {
+        serialInput.insert(serialInput.end(), data.begin(), data.end());
+        schedule(*this, now(), [this]
+                 {
+                     if (serialReceiveCb)
+                         serialReceiveCb();
+                 });
+    }
+
+    void Node::runTimers()
+    {
+        for (;;)
+        {
+            if (timerEvents.empty())
+            {
+                block(UINT64_MAX);
+                continue;
+            }
+            if (timerEvents.front().time > now())
+            {
+                block(timerEvents.front().time);
+                continue;
+            }
+
+            TimerEvent event = std::move(timerEvents.front());
+            timerEvents.pop_front();
+            event.callback();
+        }
+    }
+
+    uint64_t schedule(Node &node, uint64_t time, std::function<void()> callback)
+    {
+        TimerEvent event = {time, node.nextTimerId++, std::move(callback)};
+        uint64_t id = event.id;
+        auto position = std::upper_bound(node.timerEvents.begin(), node.timerEvents.end(), time,
+                                         [](uint64_t time, const TimerEvent &other)
+                                         { return time < other.time; });
+        node.timerEvents.insert(position, std::move(event));
+        if (node.timerTask)
+            wake(node.timerTask);
+        return id;
+    }
+
+    bool cancel(Node &node, uint64_t id)
+    {
+        auto it = std::find_if(node.timerEvents.begin(), node.timerEvents.end(), [id](const TimerEvent &event)
+                               { return event.id == id; });
+        if (it == node.timerEvents.end())
+            return false;
+        node.timerEvents.erase(it);
+        return true;
+    }
+
+    Node &firmwareNode()
+    {
+        Node *node = currentNode;
+        if (!node)
+        {
+            fprintf(stderr, "Firmware call made outside of a simulated node\n");
+            abort();
+        }
+        return *node;
+    }
+
+    void writeSerial(const char *data, size_t len)
+    {
+        Node *node = currentNode;
+        if (!node)
+        {
+            fwrite(data, 1, len, stdout);
+            return;
+        }
+
+        node->serialBytes += len;
+        if (node->serialSink)
+        {
+            node->serialSink((const uint8_t *)data, len);
+            return;
+        }
+        if (!node->echoSerial)
+            return;
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            if (data[i] == '\n')
+            {
+                printf("[%s] %s\n", node->name, node->serialLine.c_str());
+                node->serialLine.clear();
+            }
+            else if (data[i] != '\r')
+            {
+                node->serialLine += data[i];
+            }
+        }
+    }
+}
+
+namespace
+{
+    sim::Node &node()
+    {
+        return sim::firmwareNode();
+    }
+}
+
+// Arduino stand-ins
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    node().pinModes[pin] = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    node().pinLevels[pin] = val ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return node().pinLevels[pin];
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+    node().analogLevels[pin] = value;
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode)
+{
+    node().isrs[pin] = isr;
+    node().isrModes[pin] = mode;
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    node().isrs[pin] = nullptr;
+}
+
+uint32_t millis()
+{
+    return (uint32_t)(sim::now() / 1000);
+}
+
+uint32_t micros()
+{
+    return (uint32_t)sim::now();
+}
+
+// Only the calling task sleeps: the other tasks and the radio keep running meanwhile
+void delay(uint32_t ms)
+{
+    sim::sleepUntil(sim::now() + (uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    sim::sleepUntil(sim::now() + us);
+}
+
+namespace
+{
+    std::mt19937 arduinoRng(1);
+}
+
+long random(long howbig)
+{
+    if (howbig <= 0)
+        return 0;
+    return std::uniform_int_distribution<long>(0, howbig - 1)(arduinoRng);
+}
+
+long random(long howsmall, long howbig)
+{
+    if (howsmall >= howbig)
+        return howsmall;
+    return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed)
+{
+    arduinoRng.seed(seed);
+}
+
+uint32_t esp_random()
+{
+    std::deque<uint32_t> &entropy = node().entropy;
+    if (entropy.empty())
+        return arduinoRng();
+    uint32_t value = entropy.front();
+    entropy.pop_front();
+    return value;
+}
+
+// The lowest frequency the power management allows, raised by its locks. The radio holds the
+// APB at 80 MHz while it listens, as the WiFi driver does when it is not in power save.
+uint32_t getCpuFrequencyMhz()
+{
+    const sim::Node &self = node();
+    if (self.pmLocks[ESP_PM_CPU_FREQ_MAX] > 0)
+        return self.pmConfig.max_freq_mhz;
+    int frequency = self.pmConfig.min_freq_mhz;
+    bool apbLocked = self.pmLocks[ESP_PM_APB_FREQ_MAX] > 0 || (self.espNowInit && self.wifiPowerSave == WIFI_PS_NONE);
+    if (apbLocked && frequency < 80)
+        frequency = 80;
+    return frequency;
+}
+
+// FreeRTOS stand-ins
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask)
+{
+    TaskHandle_t task = sim::spawn(name, &node(), [code, parameters]
+                                   { code(parameters); });
+    if (createdTask)
+        *createdTask = task;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t coreId)
+{
+    if (coreId != tskNO_AFFINITY && (coreId < 0 || coreId > 1))
+        return pdFAIL;
+    TaskHandle_t task = sim::spawn(name, &node(), [code, parameters]
+                                   { code(parameters); }, coreId);
+    if (createdTask)
+        *createdTask = task;
+    return pdPASS;
+}
+
+BaseType_t xPortGetCoreID()
+{
+    sim::Task *task = sim::currentTask();
+    int core = task ? sim::taskCore(task) : 0;
+    return core == tskNO_AFFINITY ? 0 : core;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim::sleepUntil(sim::now() + (uint64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return sim::currentTask();
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    return sim::notify(task, value, action) ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *higherPriorityTaskWoken)
+{
+    if (higherPriorityTaskWoken)
+        *higherPriorityTaskWoken = pdFALSE;
+    return sim::notify(task, value, action) ? pdPASS : pdFAIL;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t bitsToClearOnEntry, uint32_t bitsToClearOnExit, uint32_t *notificationValue, TickType_t ticksToWait)
+{
+    uint64_t deadline = ticksToWait == portMAX_DELAY ? UINT64_MAX : sim::now() + (uint64_t)ticksToWait * portTICK_PERIOD_MS * 1000;
+    return sim::waitNotification(deadline, bitsToClearOnEntry, bitsToClearOnExit, notificationValue) ? pdTRUE : pdFALSE;
+}
+
+// Serial
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long)
+{
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    sim::writeSerial((const char *)&c, 1);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    sim::writeSerial((const char *)buffer, size);
+    return size;
+}
+
+int HardwareSerial::available()
+{
+    return node().serialInput.size();
+}
+
+int HardwareSerial::read()
+{
+    std::deque<uint8_t> &input = node().serialInput;
+    if (input.empty())
+        return -1;
+    uint8_t byte = input.front();
+    input.pop_front();
+    return byte;
+}
+
+void HardwareSerial::onReceive(OnReceiveCb function, bool)
+{
+    node().serialReceiveCb = function;
+}
+
+size_t HardwareSerial::print(const char *str)
+{
+    size_t len = strlen(str);
+    sim::writeSerial(str, len);
+    return len;
+}
+
+size_t HardwareSerial::print(const String &str)
+{
+    sim::writeSerial(str.data(), str.size());
+    return str.size();
+}
+
+size_t HardwareSerial::print(char c)
+{
+    sim::writeSerial(&c, 1);
+    return 1;
+}
+
+size_t HardwareSerial::print(unsigned char value, int base)
+{
+    return printNumber(value, base, false);
+}
+
+size_t HardwareSerial::print(int value, int base)
+{
+    return print((long long)value, base);
+}
+
+size_t HardwareSerial::print(unsigned int value, int base)
+{
+    return printNumber(value, base, false);
+}
+
+size_t HardwareSerial::print(long value, int base)
+{
+    return print((long long)value, base);
+}
+
+size_t HardwareSerial::print(unsigned long value, int base)
+{
+    return printNumber(value, base, false);
+}
+
+size_t HardwareSerial::print(long long value, int base)
+{
+    if (value < 0 && base == DEC)
+        return printNumber(0ULL - (unsigned long long)value, base, true);
+    return printNumber((unsigned long long)value, base, false);
+}
+
+size_t HardwareSerial::print(unsigned long long value, int base)
+{
+    return printNumber(value, base, false);
+}
+
+size_t HardwareSerial::print(double value, int digits)
+{
+    char text[64];
+    int len = snprintf(text, sizeof(text), "%.*f", digits, value);
+    sim::writeSerial(text, len);
+    return len;
+}
+
+size_t HardwareSerial::println()
+{
+    sim::writeSerial("\r\n", 2);
+    return 2;
+}
+
+size_t HardwareSerial::printf(const char *format, ...)
+{
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (len < 0)
+        return 0;
+    len = std::min<int>(len, sizeof(text) - 1);
+    sim::writeSerial(text, len);
+    return len;
+}
+
+size_t HardwareSerial::printNumber(unsigned long long value, int base, bool negative)
+{
+    if (base < 2)
+        base = DEC;
+
+    char text[66];
+    char *end = text + sizeof(text);
+    char *digits = end;
+    do
+    {
+        int digit = value % base;
+        *--digits = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value);
+    if (negative)
+        *--digits = '-';
+
+    sim::writeSerial(digits, end - digits);
+    return end - digits;
+}
+
+// ESP
+EspClass ESP;
+
+void EspClass::restart()
+{
+    fprintf(stderr, "[%s] ESP.restart() called, aborting simulation\n", node().name);
+    exit(EXIT_FAILURE);
+}
+
+// WiFi stand-in
+WiFiClass WiFi;
+
+bool WiFiClass::mode(wifi_mode_t)
+{
+    return true;
+}
+
+String WiFiClass::macAddress()
+{
+    return sim::formatMac(node().mac.data());
+}
+
+// ESP-NOW stand-in
+esp_err_t esp_now_init()
+{
+    node().espNowInit = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit()
+{
+    sim::Node &self = node();
+    self.espNowInit = false;
+    self.sendCb = nullptr;
+    self.recvCb = nullptr;
+    self.peers.clear();
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    if (!node().espNowInit)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    node().recvCb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    if (!node().espNowInit)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    node().sendCb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    return sim::send(node(), peer_addr, data, len);
+}
+
+esp_err_t esp_now_set_wake_window(uint16_t window)
+{
+    if (!node().espNowInit)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    node().radioWakeWindowMs = window;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    sim::Node &self = node();
+    if (!self.espNowInit)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    if (!peer)
+        return ESP_ERR_ESPNOW_ARG;
+    if (esp_now_is_peer_exist(peer->peer_addr))
+        return ESP_ERR_ESPNOW_EXIST;
+    if (self.peers.size() >= ESP_NOW_MAX_TOTAL_PEER_NUM)
+        return ESP_ERR_ESPNOW_FULL;
+
+    sim::MacAddress mac;
+    std::copy(peer->peer_addr, peer->peer_addr + ESP_NOW_ETH_ALEN, mac.begin());
+    self.peers.push_back(mac);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr)
+{
+    sim::Node &self = node();
+    for (auto it = self.peers.begin(); it != self.peers.end(); ++it)
+    {
+        if (std::equal(it->begin(), it->end(), peer_addr))
+        {
+            self.peers.erase(it);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_ESPNOW_NOT_FOUND;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    const sim::Node &self = node();
+    return std::any_of(self.peers.begin(), self.peers.end(), [peer_addr](const sim::MacAddress &mac)
+                       { return std::equal(mac.begin(), mac.end(), peer_addr); });
+}
@@ -0,0 +1,271 @@
+/*******************************************************************************
+In-process simulation of ESP32 nodes talking over ESP-NOW.
+
+Each firmware is compiled into its own namespace and bound to a sim::Node.
+The Arduino, WiFi and ESP-NOW stand-ins act on whichever node is current, so
+the same code runs unmodified against a shared radio bus instead of hardware.
+
+Time is virtual: every thread of execution (a node's Arduino loop, its WiFi
+task, the scripted player...) is a cooperative sim::Task, only one of them
+runs at a time, and the clock jumps straight to the next deadline whenever
+they are all blocked. delay(3000) costs nothing, and a run is reproducible
+from its seed.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <driver/ledc.h>
+#include <driver/rtc_io.h>
+#include <esp_now.h>
+#include <esp_partition.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/task.h>
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace sim
+{
+    const uint8_t pinCount = 40;
+
+    typedef std::array<uint8_t, ESP_NOW_ETH_ALEN> MacAddress;
+
+    class Task;
+
+    // A frame or send status waiting for the node's WiFi task
+    struct RadioEvent
+    {
+        uint64_t time;
+        bool received; // Frame to hand to the receive callback, otherwise a send status
+        MacAddress peer;
+        std::vector<uint8_t> payload;
+        esp_now_send_status_t status;
+    };
+
+    // A callback the node's timer task runs at a given time, standing in for
+    // the interrupts of peripherals such as the LEDC fade engine
+    struct TimerEvent
+    {
+        uint64_t time;
+        uint64_t id;
+        std::function<void()> callback;
+    };
+
+    struct LedcChannel
+    {
+        int pin = -1;
+        bool running = false;
+        uint32_t duty = 0;
+
+        // Fade in progress, from fadeFrom at fadeStart to fadeTo at fadeEnd
+        bool fading = false;
+        uint32_t fadeFrom = 0;
+        uint32_t fadeTo = 0;
+        uint64_t fadeStart = 0;
+        uint64_t fadeEnd = 0;
+        uint64_t fadeTimer = 0;
+        uint32_t fades = 0;
+
+        ledc_cb_t fadeCb = nullptr;
+        void *fadeArg = nullptr;
+    };
+
+    // A flash partition of a node and its contents
+    struct FlashPartition
+    {
+        esp_partition_t info;
+        std::vector<uint8_t> data;
+    };
+
+    // One simulated board: GPIO levels, ESP-NOW registration and serial output
+    class Node
+    {
+    public:
+        Node(const char *name, const uint8_t (&mac)[ESP_NOW_ETH_ALEN], void (*setup)(), void (*loop)());
+
+        // Spawn the Arduino loop task (setup() then loop() forever), the WiFi task and the timer task
+        void start();
+
+        // Drive an input pin from outside, firing the attached interrupt on a matching edge
+        void setPin(uint8_t pin, uint8_t level);
+
+        // Send bytes to the node's serial port, as a host would. They can be read at once,
+        // and the timer task runs the callback set with Serial.onReceive().
+        void receiveSerial(const std::string &data);
+
+        // Declare a data partition, blank as a freshly erased flash, like a line of partitions.csv
+        void addPartition(const char *label, esp_partition_subtype_t subtype, uint32_t address, uint32_t size);
+
+        const char *name;
+        MacAddress mac;
+        bool echoSerial = false;
+
+        // GPIO
+        uint8_t pinModes[pinCount] = {};
+        uint8_t pinLevels[pinCount] = {};
+        int analogLevels[pinCount] = {};
+        void (*isrs[pinCount])() = {};
+        int isrModes[pinCount] = {};
+
+        // ESP-NOW
+        bool espNowInit = false;
+        esp_now_send_cb_t sendCb = nullptr;
+        esp_now_recv_cb_t recvCb = nullptr;
+        std::vector<MacAddress> peers;
+        std::deque<RadioEvent> radioEvents; // Sorted by time
+        Task *wifiTask = nullptr;
+
+        // Frames the node sent, and a digest of their times, destinations and contents,
+        // which tells whether two runs of the firmware did exactly the same
+        uint64_t framesSent = 0;
+        uint64_t outputDigest = 0xcbf29ce484222325; // FNV-1a
+        bool replaying = false; // Replays a recording alone: frames sent only go into the digest
+
+        // Timer task
+        std::deque<TimerEvent> timerEvents; // Sorted by time
+        Task *timerTask = nullptr;
+        uint64_t nextTimerId = 1;
+
+        // LEDC and sleep configuration
+        LedcChannel ledc[LEDC_SPEED_MODE_MAX][LEDC_CHANNEL_MAX];
+        bool ledcFadeInstalled = false;
+        esp_sleep_pd_option_t powerDomains[ESP_PD_DOMAIN_MAX];
+
+        // Power management as the firmware configured it. Light sleep and clock scaling are only
+        // recorded, but a radio under power save misses the frames sent outside its wake window.
+        esp_pm_config_esp32_t pmConfig = {240, 240, false};
+        uint64_t wakePins = 0;   // Bit n: GPIO n wakes the chip from light sleep...
+        uint64_t wakeLevels = 0; // ...when at this level
+        bool gpioWakeup = false;
+        wifi_ps_type_t wifiPowerSave = WIFI_PS_NONE;
+        uint16_t radioWakeIntervalMs = 100;
+        uint16_t radioWakeWindowMs = 100;
+        uint32_t pmLocks[ESP_PM_LOCK_MAX] = {}; // Acquisitions held, by lock type
+
+        // Whether the radio listens for frames at a virtual time
+        bool radioListening(uint64_t time) const;
+
+        // Serial
+        std::string serialLine;
+        uint64_t serialBytes = 0;
+        std::function<void(const uint8_t *data, size_t len)> serialSink; // Takes the output instead of echoSerial when set
+        std::deque<uint8_t> serialInput;
+        std::function<void()> serialReceiveCb;
+
+        // NVS: the blobs of each Preferences namespace, by key
+        std::map<std::string, std::map<std::string, std::vector<uint8_t>>> nvs;
+        uint64_t nvsWrites = 0; // Entries written or erased, each of which wears the flash
+
+        // Raw flash partitions, by label
+        std::map<std::string, FlashPartition> partitions;
+        uint64_t flashErases = 0; // Sectors erased in the partitions
+
+        // Values esp_random() returns before drawing from the generator, such as those of a recording
+        std::deque<uint32_t> entropy;
+
+        // Number of loop() calls, which an event-driven firmware keeps low
+        uint64_t loopPasses = 0;
+
+    private:
+        void runLoop();
+        void runWifi();
+        void runTimers();
+
+        void (*setupFn)();
+        void (*loopFn)();
+    };
+
+    // Makes a node current for the lifetime of the guard, restoring the previous one after
+    class Context
+    {
+    public:
+        explicit Context(Node &node);
+        ~Context();
+
+    private:
+        Node *previous;
+    };
+
+    Node *current();
+
+    // The node running the calling firmware code; aborts when called from outside of one
+    Node &firmwareNode();
+
+    // Scheduler
+    Task *spawn(const char *name, Node *node, std::function<void()> body, int core = tskNO_AFFINITY);
+    Task *currentTask();
+    int taskCore(const Task *task);
+
+    // Block the current task until the deadline or an earlier wake(); returns true when woken
+    bool block(uint64_t deadline);
+    void sleepUntil(uint64_t time);
+    void wake(Task *task);
+
+    // Task notifications, with the semantics of xTaskNotify() and xTaskNotifyWait()
+    bool notify(Task *task, uint32_t value, eNotifyAction action);
+    bool waitNotification(uint64_t deadline, uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value);
+
+    // Run the tasks until one of them calls stop(); returns false if they all block forever
+    bool run();
+    [[noreturn]] void stop();
+
+    // Shortest time between two loop() calls, in virtual microseconds. A call
+    // that blocked at least that long is followed by the next one right away.
+    uint32_t &loopPeriodUs();
+
+    // Run a callback on the node's timer task at the given virtual time. Returns an id for cancel().
+    uint64_t schedule(Node &node, uint64_t time, std::function<void()> callback);
+    bool cancel(Node &node, uint64_t id);
+
+    // Radio bus
+    struct BusConfig
+    {
+        uint32_t latencyUs = 1000; // Air time plus stack overhead for one frame
+        double lossRate = 0.0;     // Probability for a frame to be lost on its way to one receiver
+    };
+
+    struct BusStats
+    {
+        uint64_t sent = 0;
+        uint64_t delivered = 0;
+        uint64_t lost = 0;
+        uint64_t undeliverable = 0;
+        uint64_t missedAsleep = 0; // Frames that came while the receiver's radio slept
+    };
+
+    void attach(Node &node);
+
+    // Queue a frame or a send status for the node's WiFi task, as the bus does when it
+    // carries a frame. A replay delivers those of a recording with it.
+    void post(Node &node, RadioEvent event);
+
+    BusConfig &busConfig();
+    const BusStats &busStats();
+    void seed(uint32_t value);
+
+    // Virtual microseconds since the start of the simulation
+    uint64_t now();
+
+    // Read or write a node's NVS as a text file, one "namespace key hex" line per entry.
+    // Loading a missing file leaves the NVS empty and succeeds.
+    bool loadNvs(Node &node, const char *path);
+    bool saveNvs(const Node &node, const char *path);
+
+    // Read or write the image of a node's partition. Loading a missing file leaves the
+    // partition blank and succeeds; an image of another size is refused.
+    bool loadPartition(Node &node, const char *label, const char *path);
+    bool savePartition(const Node &node, const char *label, const char *path);
+
+    std::string formatMac(const uint8_t *mac);
+}
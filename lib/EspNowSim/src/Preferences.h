@@ -0,0 +1,36 @@
+/*******************************************************************************
+Host-side stand-in for the Arduino-ESP32 Preferences library. Each simulated
+node has its own NVS, kept in memory (see sim::loadNvs() to carry it over
+from one run to the next). Only the calls used by the firmwares are provided.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+class Preferences
+{
+public:
+    // Open a namespace, creating it unless readOnly. Returns false on failure.
+    bool begin(const char *name, bool readOnly = false, const char *partitionLabel = nullptr);
+    void end();
+
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key);
+
+    size_t putUChar(const char *key, uint8_t value);
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0);
+
+    size_t putBytes(const char *key, const void *value, size_t len);
+    size_t getBytesLength(const char *key);
+    // Copy a blob into buf. Returns its length, 0 if it is missing or longer than maxLen.
+    size_t getBytes(const char *key, void *buf, size_t maxLen);
+
+private:
+    std::string name;
+    bool opened = false;
+    bool readOnly = false;
+};
@@ -0,0 +1,384 @@
+/*******************************************************************************
+Stand-ins for the ESP-IDF peripheral drivers used by the firmwares: the LEDC
+fade engine, the high resolution timer, the sleep and power management
+configuration and the WiFi power save. Hardware that acts on its own, like
+a fade reaching its target, is driven by the node's timer task.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#include "EspNowSim.h"
+
+namespace
+{
+    sim::Node &node()
+    {
+        return sim::firmwareNode();
+    }
+
+    sim::LedcChannel *ledcChannel(ledc_mode_t mode, ledc_channel_t channel)
+    {
+        if (mode < 0 || mode >= LEDC_SPEED_MODE_MAX || channel < 0 || channel >= LEDC_CHANNEL_MAX)
+            return nullptr;
+        return &node().ledc[mode][channel];
+    }
+
+    // Duty of a channel at the current time, following its fade
+    uint32_t currentDuty(const sim::LedcChannel &channel)
+    {
+        if (!channel.fading || sim::now() >= channel.fadeEnd)
+            return channel.fading ? channel.fadeTo : channel.duty;
+
+        double progress = (double)(sim::now() - channel.fadeStart) / (channel.fadeEnd - channel.fadeStart);
+        return (uint32_t)(channel.fadeFrom + ((double)channel.fadeTo - channel.fadeFrom) * progress + 0.5);
+    }
+
+    void setOutput(sim::Node &node, sim::LedcChannel &channel, uint32_t duty)
+    {
+        channel.duty = duty;
+        if (channel.pin >= 0 && channel.pin < sim::pinCount && channel.running)
+            node.analogLevels[channel.pin] = duty;
+    }
+
+    // End the fade of a channel and raise the fade end interrupt
+    void finishFade(sim::Node &node, ledc_mode_t mode, ledc_channel_t channel)
+    {
+        sim::LedcChannel &state = node.ledc[mode][channel];
+        if (!state.fading)
+            return;
+
+        state.fading = false;
+        state.fades++;
+        setOutput(node, state, state.fadeTo);
+        if (state.fadeCb)
+        {
+            ledc_cb_param_t param = {LEDC_FADE_END_EVT, (uint32_t)mode, (uint32_t)channel, state.duty};
+            state.fadeCb(&param, state.fadeArg);
+        }
+    }
+}
+
+// LEDC stand-ins
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf)
+{
+    if (!timer_conf || timer_conf->speed_mode < 0 || timer_conf->speed_mode >= LEDC_SPEED_MODE_MAX ||
+        timer_conf->timer_num < 0 || timer_conf->timer_num >= LEDC_TIMER_MAX || timer_conf->freq_hz == 0)
+        return ESP_ERR_INVALID_ARG;
+    // The 8 MHz RTC clock only feeds the low speed timers
+    if (timer_conf->clk_cfg == LEDC_USE_RTC8M_CLK && timer_conf->speed_mode != LEDC_LOW_SPEED_MODE)
+        return ESP_ERR_INVALID_ARG;
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf)
+{
+    if (!ledc_conf)
+        return ESP_ERR_INVALID_ARG;
+    sim::LedcChannel *channel = ledcChannel(ledc_conf->speed_mode, ledc_conf->channel);
+    if (!channel || ledc_conf->gpio_num < 0 || ledc_conf->gpio_num >= sim::pinCount)
+        return ESP_ERR_INVALID_ARG;
+
+    channel->pin = ledc_conf->gpio_num;
+    channel->running = true;
+    setOutput(node(), *channel, ledc_conf->duty);
+    return ESP_OK;
+}
+
+esp_err_t ledc_stop(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t idle_level)
+{
+    sim::LedcChannel *state = ledcChannel(speed_mode, channel);
+    if (!state)
+        return ESP_ERR_INVALID_ARG;
+
+    state->running = false;
+    if (state->pin >= 0)
+    {
+        node().analogLevels[state->pin] = 0;
+        node().pinLevels[state->pin] = idle_level ? HIGH : LOW;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty_and_update(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty, uint32_t hpoint)
+{
+    sim::LedcChannel *state = ledcChannel(speed_mode, channel);
+    if (!state)
+        return ESP_ERR_INVALID_ARG;
+
+    // Like the driver, wait for a fade in progress to end first
+    if (state->fading)
+    {
+        sim::sleepUntil(state->fadeEnd);
+        sim::cancel(node(), state->fadeTimer);
+        finishFade(node(), speed_mode, channel);
+    }
+    setOutput(node(), *state, duty);
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    sim::LedcChannel *state = ledcChannel(speed_mode, channel);
+    return state ? currentDuty(*state) : 0;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags)
+{
+    node().ledcFadeInstalled = true;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, uint32_t max_fade_time_ms, ledc_fade_mode_t fade_mode)
+{
+    sim::Node &self = node();
+    sim::LedcChannel *state = ledcChannel(speed_mode, channel);
+    if (!state)
+        return ESP_ERR_INVALID_ARG;
+    if (!self.ledcFadeInstalled)
+        return ESP_ERR_INVALID_STATE;
+
+    // The driver waits for the previous fade of the channel to end
+    if (state->fading)
+    {
+        sim::sleepUntil(state->fadeEnd);
+        sim::cancel(self, state->fadeTimer);
+        finishFade(self, speed_mode, channel);
+    }
+
+    state->fading = true;
+    state->fadeFrom = state->duty;
+    state->fadeTo = target_duty;
+    state->fadeStart = sim::now();
+    state->fadeEnd = sim::now() + (uint64_t)max_fade_time_ms * 1000;
+    state->fadeTimer = sim::schedule(self, state->fadeEnd, [&self, speed_mode, channel]
+                                     { finishFade(self, speed_mode, channel); });
+
+    if (fade_mode == LEDC_FADE_WAIT_DONE)
+        sim::sleepUntil(state->fadeEnd);
+    return ESP_OK;
+}
+
+esp_err_t ledc_cb_register(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_cbs_t *cbs, void *user_arg)
+{
+    sim::LedcChannel *state = ledcChannel(speed_mode, channel);
+    if (!state || !cbs)
+        return ESP_ERR_INVALID_ARG;
+
+    state->fadeCb = cbs->fade_cb;
+    state->fadeArg = user_arg;
+    return ESP_OK;
+}
+
+// esp_timer stand-ins
+struct esp_timer
+{
+    sim::Node *node;
+    esp_timer_cb_t callback;
+    void *arg;
+    uint64_t period = 0; // 0 for a one-shot timer
+    uint64_t event = 0;  // Timer task event of the next alarm
+    bool active = false;
+};
+
+namespace
+{
+    void armTimer(esp_timer_handle_t timer, uint64_t time)
+    {
+        timer->event = sim::schedule(*timer->node, time, [timer, time]
+                                     {
+                                         // Like the driver, a periodic timer is armed again before its callback runs
+                                         if (timer->period > 0)
+                                             armTimer(timer, time + timer->period);
+                                         else
+                                             timer->active = false;
+                                         timer->callback(timer->arg);
+                                     });
+    }
+
+    esp_err_t startTimer(esp_timer_handle_t timer, uint64_t delay, uint64_t period)
+    {
+        if (!timer)
+            return ESP_ERR_INVALID_ARG;
+        if (timer->active)
+            return ESP_ERR_INVALID_STATE;
+        timer->active = true;
+        timer->period = period;
+        armTimer(timer, sim::now() + delay);
+        return ESP_OK;
+    }
+}
+
+int64_t esp_timer_get_time()
+{
+    return (int64_t)sim::now();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    if (!create_args || !create_args->callback || !out_handle)
+        return ESP_ERR_INVALID_ARG;
+    *out_handle = new esp_timer{&node(), create_args->callback, create_args->arg};
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return startTimer(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    if (period == 0)
+        return ESP_ERR_INVALID_ARG;
+    return startTimer(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer)
+        return ESP_ERR_INVALID_ARG;
+    if (!timer->active)
+        return ESP_ERR_INVALID_STATE;
+    sim::cancel(*timer->node, timer->event);
+    timer->active = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (!timer)
+        return ESP_ERR_INVALID_ARG;
+    if (timer->active)
+        return ESP_ERR_INVALID_STATE;
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer && timer->active;
+}
+
+// Sleep stand-ins
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t domain, esp_sleep_pd_option_t option)
+{
+    if (domain < 0 || domain >= ESP_PD_DOMAIN_MAX)
+        return ESP_ERR_INVALID_ARG;
+    node().powerDomains[domain] = option;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup()
+{
+    node().gpioWakeup = true;
+    return ESP_OK;
+}
+
+// RTC IO stand-ins
+bool rtc_gpio_is_valid_gpio(gpio_num_t gpio_num)
+{
+    static const uint64_t rtcPins = 0xFF0E00F015;
+    return gpio_num >= 0 && gpio_num < GPIO_NUM_MAX && (rtcPins >> gpio_num & 1);
+}
+
+esp_err_t rtc_gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    if (!rtc_gpio_is_valid_gpio(gpio_num) || (intr_type != GPIO_INTR_LOW_LEVEL && intr_type != GPIO_INTR_HIGH_LEVEL))
+        return ESP_ERR_INVALID_ARG;
+    sim::Node &self = node();
+    uint64_t bit = 1ULL << gpio_num;
+    self.wakePins |= bit;
+    self.wakeLevels = intr_type == GPIO_INTR_HIGH_LEVEL ? self.wakeLevels | bit : self.wakeLevels & ~bit;
+    return ESP_OK;
+}
+
+// Power management stand-ins
+esp_err_t esp_pm_configure(const void *config)
+{
+    const esp_pm_config_esp32_t *pm = static_cast<const esp_pm_config_esp32_t *>(config);
+    if (!pm)
+        return ESP_ERR_INVALID_ARG;
+    static const int frequencies[] = {80, 160, 240};
+    bool valid = false, validMin = false;
+    for (int frequency : frequencies)
+    {
+        valid = valid || pm->max_freq_mhz == frequency;
+        validMin = validMin || pm->min_freq_mhz == frequency;
+    }
+    // The APB clock runs at 80 MHz, or from the 40 MHz crystal when the CPU runs that slow
+    validMin = validMin || pm->min_freq_mhz == 40;
+    if (!valid || !validMin || pm->min_freq_mhz > pm->max_freq_mhz)
+        return ESP_ERR_INVALID_ARG;
+    node().pmConfig = *pm;
+    return ESP_OK;
+}
+
+struct esp_pm_lock
+{
+    sim::Node *node;
+    esp_pm_lock_type_t type;
+    uint32_t count;
+};
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle)
+{
+    if (lock_type < ESP_PM_CPU_FREQ_MAX || lock_type >= ESP_PM_LOCK_MAX || !out_handle)
+        return ESP_ERR_INVALID_ARG;
+    *out_handle = new esp_pm_lock{&node(), lock_type, 0};
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    if (!handle)
+        return ESP_ERR_INVALID_ARG;
+    handle->count++;
+    handle->node->pmLocks[handle->type]++;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    if (!handle)
+        return ESP_ERR_INVALID_ARG;
+    if (handle->count == 0)
+        return ESP_ERR_INVALID_STATE;
+    handle->count--;
+    handle->node->pmLocks[handle->type]--;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle)
+{
+    if (!handle)
+        return ESP_ERR_INVALID_ARG;
+    if (handle->count > 0)
+        return ESP_ERR_INVALID_STATE;
+    delete handle;
+    return ESP_OK;
+}
+
+// WiFi power save stand-ins
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    if (type < WIFI_PS_NONE || type > WIFI_PS_MAX_MODEM)
+        return ESP_ERR_INVALID_ARG;
+    node().wifiPowerSave = type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *type)
+{
+    if (!type)
+        return ESP_ERR_INVALID_ARG;
+    *type = node().wifiPowerSave;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connectionless_module_set_wake_interval(uint16_t wake_interval)
+{
+    if (wake_interval == 0)
+        return ESP_ERR_INVALID_ARG;
+    node().radioWakeIntervalMs = wake_interval;
+    return ESP_OK;
+}
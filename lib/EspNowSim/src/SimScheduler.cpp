@@ -0,0 +1,271 @@
+/*******************************************************************************
+Cooperative scheduler and virtual clock of the simulation.
+
+Every task runs on its own host thread, but a single baton is passed between
+them so exactly one executes at a time. A task gives the baton away when it
+blocks; the next ready task takes it, and when none is ready the clock jumps
+to the earliest deadline. Ties are broken by spawn order, which keeps a run
+deterministic.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#include "EspNowSim.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace sim
+{
+    class Task
+    {
+    public:
+        const char *name;
+        Node *node;
+        std::function<void()> body;
+        size_t index;
+        int core;
+
+        std::condition_variable turn;
+        bool blocked = false;
+        bool woken = false;
+        uint64_t deadline = 0;
+
+        bool notified = false;
+        uint32_t notificationValue = 0;
+    };
+
+    namespace
+    {
+        const uint64_t forever = std::numeric_limits<uint64_t>::max();
+
+        // Never destroyed: tasks may still be parked on them when the process exits
+        std::mutex &lock = *new std::mutex;
+        std::condition_variable &finished = *new std::condition_variable;
+
+        std::vector<Task *> tasks;
+        std::deque<Task *> ready;
+        Task *running = nullptr;
+        uint64_t virtualNow = 0;
+        uint32_t loopPeriod = 1000;
+        bool stopped = false;
+        bool deadlocked = false;
+
+        thread_local Task *self = nullptr;
+
+        // Pick the task to run next, advancing the clock if nothing is ready. Called with the lock held.
+        Task *next()
+        {
+            if (ready.empty())
+            {
+                Task *earliest = nullptr;
+                for (Task *task : tasks)
+                {
+                    if (task->blocked && task->deadline != forever && (!earliest || task->deadline < earliest->deadline))
+                        earliest = task;
+                }
+                if (!earliest)
+                    return nullptr;
+
+                if (earliest->deadline > virtualNow)
+                    virtualNow = earliest->deadline;
+                earliest->blocked = false;
+                earliest->woken = false;
+                return earliest;
+            }
+
+            Task *task = ready.front();
+            ready.pop_front();
+            return task;
+        }
+
+        // Hand the baton to the next task and wait until it comes back. Called with the lock held.
+        void yield(std::unique_lock<std::mutex> &guard, Task *task)
+        {
+            if (stopped)
+            {
+                finished.notify_all();
+                task->turn.wait(guard, []
+                                { return false; });
+            }
+
+            Task *successor = next();
+            if (!successor)
+            {
+                deadlocked = true;
+                finished.notify_all();
+            }
+            running = successor;
+            if (successor == task)
+                return;
+            if (successor)
+                successor->turn.notify_one();
+            task->turn.wait(guard, [task]
+                            { return running == task; });
+        }
+
+        void threadMain(Task *task)
+        {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                task->turn.wait(guard, [task]
+                                { return running == task; });
+            }
+            self = task;
+            if (task->node)
+            {
+                Context context(*task->node);
+                task->body();
+            }
+            else
+            {
+                task->body();
+            }
+
+            // A finished task leaves the baton to the others for good
+            std::unique_lock<std::mutex> guard(lock);
+            task->blocked = true;
+            task->deadline = forever;
+            yield(guard, task);
+        }
+    }
+
+    Task *spawn(const char *name, Node *node, std::function<void()> body, int core)
+    {
+        Task *task = new Task;
+        task->name = name;
+        task->node = node;
+        task->body = std::move(body);
+        task->core = core;
+
+        std::lock_guard<std::mutex> guard(lock);
+        task->index = tasks.size();
+        tasks.push_back(task);
+        ready.push_back(task);
+        std::thread(threadMain, task).detach();
+        return task;
+    }
+
+    Task *currentTask()
+    {
+        return self;
+    }
+
+    int taskCore(const Task *task)
+    {
+        return task->core;
+    }
+
+    bool block(uint64_t deadline)
+    {
+        Task *task = self;
+        std::unique_lock<std::mutex> guard(lock);
+        if (deadline <= virtualNow)
+        {
+            // Nothing to wait for, but give tasks ready at this instant their turn
+            ready.push_back(task);
+            yield(guard, task);
+            return false;
+        }
+
+        task->blocked = true;
+        task->woken = false;
+        task->deadline = deadline;
+        yield(guard, task);
+        return task->woken;
+    }
+
+    void sleepUntil(uint64_t time)
+    {
+        while (virtualNow < time)
+            block(time);
+    }
+
+    void wake(Task *task)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!task->blocked)
+            return;
+        task->blocked = false;
+        task->woken = true;
+        ready.push_back(task);
+    }
+
+    bool notify(Task *task, uint32_t value, eNotifyAction action)
+    {
+        switch (action)
+        {
+        case eNoAction:
+            break;
+        case eSetBits:
+            task->notificationValue |= value;
+            break;
+        case eIncrement:
+            task->notificationValue++;
+            break;
+        case eSetValueWithOverwrite:
+            task->notificationValue = value;
+            break;
+        case eSetValueWithoutOverwrite:
+            if (task->notified)
+                return false;
+            task->notificationValue = value;
+            break;
+        }
+        task->notified = true;
+        wake(task);
+        return true;
+    }
+
+    bool waitNotification(uint64_t deadline, uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value)
+    {
+        Task *task = self;
+        if (!task->notified)
+            task->notificationValue &= ~clearOnEntry;
+        while (!task->notified && virtualNow < deadline)
+            block(deadline);
+
+        if (value)
+            *value = task->notificationValue;
+        if (!task->notified)
+            return false;
+        task->notified = false;
+        task->notificationValue &= ~clearOnExit;
+        return true;
+    }
+
+    bool run()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        running = next();
+        if (running)
+            running->turn.notify_one();
+        else
+            deadlocked = true;
+        finished.wait(guard, []
+                      { return stopped || deadlocked; });
+        return stopped;
+    }
+
+    void stop()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        stopped = true;
+        yield(guard, self);
+        abort(); // yield() never returns once stopped
+    }
+
+    uint32_t &loopPeriodUs()
+    {
+        return loopPeriod;
+    }
+
+    uint64_t now()
+    {
+        return virtualNow;
+    }
+}
@@ -0,0 +1,284 @@
+/*******************************************************************************
+Stand-ins for the NVS-backed Preferences library and the partition API. Every
+node keeps its NVS entries in memory as blobs, whatever their type, and its
+raw partitions as byte images; both can be saved to files so the next run
+boots with them like a board would after a reset.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#include "EspNowSim.h"
+
+#include <Preferences.h>
+#include <esp_partition.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+namespace
+{
+    // NVS keys and namespaces are limited to 15 characters
+    const size_t maxNvsKeyLength = 15;
+
+    std::map<std::string, std::vector<uint8_t>> &entries(const std::string &name)
+    {
+        return sim::firmwareNode().nvs[name];
+    }
+
+    const std::vector<uint8_t> *find(const std::string &name, const char *key)
+    {
+        auto &space = entries(name);
+        auto entry = space.find(key);
+        return entry == space.end() ? nullptr : &entry->second;
+    }
+
+    // The contents of a partition returned by esp_partition_find_first() on the current node
+    std::vector<uint8_t> *image(const esp_partition_t *partition)
+    {
+        for (auto &entry : sim::firmwareNode().partitions)
+        {
+            if (&entry.second.info == partition)
+                return &entry.second.data;
+        }
+        return nullptr;
+    }
+
+    esp_err_t checkRange(const std::vector<uint8_t> *data, size_t offset, size_t size)
+    {
+        if (!data)
+            return ESP_ERR_INVALID_ARG;
+        return offset > data->size() || size > data->size() - offset ? ESP_ERR_INVALID_SIZE : ESP_OK;
+    }
+}
+
+bool Preferences::begin(const char *name, bool readOnly, const char *partitionLabel)
+{
+    if (opened || !name || strlen(name) > maxNvsKeyLength)
+        return false;
+
+    // Like the real library, a read-only open fails on a namespace that was never written
+    sim::Node &node = sim::firmwareNode();
+    if (readOnly && node.nvs.find(name) == node.nvs.end())
+        return false;
+
+    if (!readOnly)
+        node.nvs[name];
+    this->name = name;
+    this->readOnly = readOnly;
+    opened = true;
+    return true;
+}
+
+void Preferences::end()
+{
+    opened = false;
+}
+
+bool Preferences::clear()
+{
+    if (!opened || readOnly)
+        return false;
+    entries(name).clear();
+    sim::firmwareNode().nvsWrites++;
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    if (!opened || readOnly)
+        return false;
+    if (entries(name).erase(key) == 0)
+        return false;
+    sim::firmwareNode().nvsWrites++;
+    return true;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    return opened && find(name, key);
+}
+
+size_t Preferences::putUChar(const char *key, uint8_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint8_t Preferences::getUChar(const char *key, uint8_t defaultValue)
+{
+    uint8_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len)
+{
+    if (!opened || readOnly || !key || strlen(key) > maxNvsKeyLength || (!value && len > 0))
+        return 0;
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(value);
+    entries(name)[key].assign(bytes, bytes + len);
+    sim::firmwareNode().nvsWrites++;
+    return len;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    const std::vector<uint8_t> *blob = opened ? find(name, key) : nullptr;
+    return blob ? blob->size() : 0;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen)
+{
+    const std::vector<uint8_t> *blob = opened ? find(name, key) : nullptr;
+    if (!blob || blob->size() > maxLen)
+        return 0;
+
+    std::copy(blob->begin(), blob->end(), static_cast<uint8_t *>(buf));
+    return blob->size();
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    for (const auto &entry : sim::firmwareNode().partitions)
+    {
+        const esp_partition_t &info = entry.second.info;
+        if ((type == ESP_PARTITION_TYPE_ANY || info.type == type) &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || info.subtype == subtype) &&
+            (!label || entry.first == label))
+            return &info;
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    std::vector<uint8_t> *data = image(partition);
+    esp_err_t status = checkRange(data, src_offset, size);
+    if (status == ESP_OK)
+        memcpy(dst, data->data() + src_offset, size);
+    return status;
+}
+
+// Programming NOR flash can only clear bits; setting them again takes an erase
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    std::vector<uint8_t> *data = image(partition);
+    esp_err_t status = checkRange(data, dst_offset, size);
+    if (status != ESP_OK)
+        return status;
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(src);
+    for (size_t i = 0; i < size; ++i)
+    {
+        (*data)[dst_offset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    std::vector<uint8_t> *data = image(partition);
+    esp_err_t status = checkRange(data, offset, size);
+    if (status != ESP_OK)
+        return status;
+    if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0)
+        return ESP_ERR_INVALID_ARG;
+
+    std::fill(data->begin() + offset, data->begin() + offset + size, 0xFF);
+    sim::firmwareNode().flashErases += size / SPI_FLASH_SEC_SIZE;
+    return ESP_OK;
+}
+
+namespace sim
+{
+    bool loadNvs(Node &node, const char *path)
+    {
+        FILE *file = fopen(path, "r");
+        if (!file)
+            return errno == ENOENT;
+
+        char space[maxNvsKeyLength + 1], key[maxNvsKeyLength + 1];
+        char hex[2 * 4000 + 1];
+        bool ok = true;
+        int fields;
+        while ((fields = fscanf(file, "%15s %15s %8000s", space, key, hex)) == 3)
+        {
+            std::vector<uint8_t> blob;
+            for (size_t i = 0; hex[i] && hex[i + 1]; i += 2)
+            {
+                unsigned byte;
+                if (sscanf(hex + i, "%2x", &byte) != 1)
+                    ok = false;
+                blob.push_back(byte);
+            }
+            if (strcmp(hex, "-") == 0)
+                blob.clear();
+            node.nvs[space][key] = blob;
+        }
+        ok = ok && fields == EOF;
+        fclose(file);
+        return ok;
+    }
+
+    bool saveNvs(const Node &node, const char *path)
+    {
+        FILE *file = fopen(path, "w");
+        if (!file)
+            return false;
+
+        for (const auto &space : node.nvs)
+        {
+            for (const auto &entry : space.second)
+            {
+                fprintf(file, "%s %s ", space.first.c_str(), entry.first.c_str());
+                for (uint8_t byte : entry.second)
+                {
+                    fprintf(file, "%02x", byte);
+                }
+                fprintf(file, "%s\n", entry.second.empty() ? "-" : "");
+            }
+        }
+        return fclose(file) == 0;
+    }
+
+    void Node::addPartition(const char *label, esp_partition_subtype_t subtype, uint32_t address, uint32_t size)
+    {
+        FlashPartition &partition = partitions[label];
+        partition.info = {nullptr, ESP_PARTITION_TYPE_DATA, subtype, address, size, {}, false};
+        snprintf(partition.info.label, sizeof(partition.info.label), "%s", label);
+        partition.data.assign(size, 0xFF);
+    }
+
+    bool loadPartition(Node &node, const char *label, const char *path)
+    {
+        auto partition = node.partitions.find(label);
+        if (partition == node.partitions.end())
+            return false;
+
+        FILE *file = fopen(path, "rb");
+        if (!file)
+            return errno == ENOENT;
+
+        std::vector<uint8_t> &data = partition->second.data;
+        std::vector<uint8_t> contents(data.size());
+        bool ok = fread(contents.data(), 1, contents.size(), file) == contents.size() && fgetc(file) == EOF;
+        fclose(file);
+        if (ok)
+            data = contents;
+        return ok;
+    }
+
+    bool savePartition(const Node &node, const char *label, const char *path)
+    {
+        auto partition = node.partitions.find(label);
+        if (partition == node.partitions.end())
+            return false;
+
+        FILE *file = fopen(path, "wb");
+        if (!file)
+            return false;
+        const std::vector<uint8_t> &data = partition->second.data;
+        bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+        return fclose(file) == 0 && ok;
+    }
+}
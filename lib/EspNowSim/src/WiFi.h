@@ -0,0 +1,32 @@
+/*******************************************************************************
+Host-side stand-in for the Arduino-ESP32 WiFi class. Only the station setup
+and MAC address lookup used by the firmwares are provided.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+typedef enum
+{
+    WIFI_MODE_NULL = 0,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA
+} wifi_mode_t;
+
+#define WIFI_OFF WIFI_MODE_NULL
+#define WIFI_STA WIFI_MODE_STA
+#define WIFI_AP WIFI_MODE_AP
+#define WIFI_AP_STA WIFI_MODE_APSTA
+
+class WiFiClass
+{
+public:
+    bool mode(wifi_mode_t mode);
+    String macAddress();
+};
+
+extern WiFiClass WiFi;
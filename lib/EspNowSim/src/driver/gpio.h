@@ -0,0 +1,28 @@
+/*******************************************************************************
+Host-side stand-in for the ESP-IDF GPIO driver types. Pins are driven through
+the Arduino stand-ins; only what the wakeup configuration needs is here.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <esp_err.h>
+
+typedef enum
+{
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_0 = 0,
+    GPIO_NUM_MAX = 40
+} gpio_num_t;
+
+typedef enum
+{
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE,
+    GPIO_INTR_LOW_LEVEL,
+    GPIO_INTR_HIGH_LEVEL,
+    GPIO_INTR_MAX
+} gpio_int_type_t;
@@ -0,0 +1,17 @@
+/*******************************************************************************
+Host-side stand-in for the ESP-IDF RTC IO driver: the pins that can wake the
+chip from light sleep, and the level they do it on.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <driver/gpio.h>
+#include <esp_err.h>
+
+// Whether the pin is one of the ESP32's RTC GPIOs: 0, 2, 4, 12 to 15, 25 to 27 and 32 to 39
+bool rtc_gpio_is_valid_gpio(gpio_num_t gpio_num);
+
+// Wake the chip when the pin is at the level, GPIO_INTR_LOW_LEVEL or GPIO_INTR_HIGH_LEVEL
+esp_err_t rtc_gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type);
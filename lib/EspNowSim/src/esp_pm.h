@@ -0,0 +1,38 @@
+/*******************************************************************************
+Host-side stand-in for the ESP-IDF power management. The simulation does not
+scale a clock or sleep; it records the configuration the firmware asked for
+and the locks it holds, from which getCpuFrequencyMhz() tells the frequency
+the chip would run at.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <esp_err.h>
+
+typedef struct
+{
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_esp32_t;
+
+// Takes an esp_pm_config_esp32_t, like the chip-specific structure the driver expects
+esp_err_t esp_pm_configure(const void *config);
+
+typedef enum
+{
+    ESP_PM_CPU_FREQ_MAX,   // The CPU runs at max_freq_mhz
+    ESP_PM_APB_FREQ_MAX,   // The APB runs at 80 MHz, and the CPU at least as fast
+    ESP_PM_NO_LIGHT_SLEEP, // Automatic light sleep is held off
+    ESP_PM_LOCK_MAX,
+} esp_pm_lock_type_t;
+
+typedef struct esp_pm_lock *esp_pm_lock_handle_t;
+
+// Locks count their acquisitions: each must be released as many times
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle);
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle);
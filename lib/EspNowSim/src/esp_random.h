@@ -0,0 +1,14 @@
+/*******************************************************************************
+Host-side stand-in for the ESP-IDF hardware random number generator. The
+values come from the same seeded generator as Arduino's random(), so a
+simulation run is reproducible from its seed, unless the node has values of
+its own queued in Node::entropy, as when it replays a recording.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+uint32_t esp_random();
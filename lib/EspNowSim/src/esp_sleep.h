@@ -0,0 +1,32 @@
+/*******************************************************************************
+Host-side stand-in for the ESP-IDF sleep configuration. The simulation never
+sleeps; it records which power domains the firmware keeps on and whether
+GPIOs may wake it.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <esp_err.h>
+
+typedef enum
+{
+    ESP_PD_DOMAIN_RTC_PERIPH,
+    ESP_PD_DOMAIN_RTC_SLOW_MEM,
+    ESP_PD_DOMAIN_RTC_FAST_MEM,
+    ESP_PD_DOMAIN_XTAL,
+    ESP_PD_DOMAIN_RTC8M,
+    ESP_PD_DOMAIN_VDDSDIO,
+    ESP_PD_DOMAIN_MAX
+} esp_sleep_pd_domain_t;
+
+typedef enum
+{
+    ESP_PD_OPTION_OFF,
+    ESP_PD_OPTION_ON,
+    ESP_PD_OPTION_AUTO
+} esp_sleep_pd_option_t;
+
+esp_err_t esp_sleep_pd_config(esp_sleep_pd_domain_t domain, esp_sleep_pd_option_t option);
+esp_err_t esp_sleep_enable_gpio_wakeup();
@@ -0,0 +1,29 @@
+/*******************************************************************************
+Host-side stand-in for the ESP-IDF WiFi power save settings. With power save
+on, a node's radio listens for ESP-NOW frames during a wake window at the
+start of every wake interval (see esp_now_set_wake_window()); the simulated
+bus drops the frames it sleeps through.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <esp_err.h>
+
+// Core of the WiFi task, which esp_wifi.h derives from CONFIG_ESP32_WIFI_TASK_PINNED_TO_CORE_1
+#define WIFI_TASK_CORE_ID 0
+
+typedef enum
+{
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *type);
+
+// Milliseconds between the wakes of the radio when no access point is connected
+esp_err_t esp_wifi_connectionless_module_set_wake_interval(uint16_t wake_interval);
@@ -0,0 +1,40 @@
+/*******************************************************************************
+Host-side stand-in for the FreeRTOS base types and macros used by the
+firmwares. One tick is one millisecond, as in the Arduino-ESP32 build.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+
+// The core the calling task runs on: the one it is pinned to, or 0. Simulated tasks share the host's.
+BaseType_t xPortGetCoreID();
+
+// Interrupts run inside the task that raised the pin, so the simulation is never in one
+inline BaseType_t xPortInIsrContext()
+{
+    return 0;
+}
+
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+// Interrupts run inside the task that raised the pin, which hands over at its next block
+#define portYIELD_FROM_ISR(...) \
+    do                          \
+    {                           \
+    } while (0)
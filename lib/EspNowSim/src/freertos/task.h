@@ -0,0 +1,41 @@
+/*******************************************************************************
+Host-side stand-in for the FreeRTOS task API: task creation, delays and
+notifications. A task handle is the simulated task itself (see EspNowSim.h).
+Priorities are ignored; simulated tasks only yield when they block. Cores are
+recorded for xPortGetCoreID(), but all tasks share the one baton.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+namespace sim
+{
+    class Task;
+}
+
+typedef sim::Task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+
+typedef enum
+{
+    eNoAction,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite
+} eNotifyAction;
+
+// The task runs on the node of the caller
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t coreId);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *higherPriorityTaskWoken);
+BaseType_t xTaskNotifyWait(uint32_t bitsToClearOnEntry, uint32_t bitsToClearOnExit, uint32_t *notificationValue, TickType_t ticksToWait);
@@ -0,0 +1,102 @@
+/*******************************************************************************
+Event-driven loop() built on FreeRTOS task notifications.
+
+Interrupts and ESP-NOW callbacks post event bits to the loop task instead of
+raising volatile flags, and loop() blocks in wait() until one arrives or the
+next timer of the state machine is due. While blocked, the loop task costs no
+CPU time and the idle task may lower the power draw; when an event comes in,
+the task wakes up at once rather than on its next poll.
+
+A task notification is used as a lightweight event group: setting bits is
+cheaper than an event group or a queue, and unlike xEventGroupSetBitsFromISR
+it needs no detour through the timer task.
+
+Events accumulate until the state machine takes them, so one posted while a
+state ignores it is still there when a state that cares about it is entered.
+
+The work is split between the two cores. The radio's core runs the WiFi task,
+where the ESP-NOW callbacks hand the frames over through lock-free queues,
+and everything else in the background: the esp_timer callbacks, the log
+writer. The game's core is left to loop() alone, so a burst of frames or a
+log flush never stands between a guess and its verdict. esp_now_send() only
+passes the frame on to the WiFi task, which puts it on air from its core.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// The cores of the WiFi task and of the task running loop(), both chosen in the sdkconfig
+const BaseType_t radioCore = WIFI_TASK_CORE_ID;
+const BaseType_t gameCore = ARDUINO_RUNNING_CORE;
+
+class EventLoop
+{
+public:
+    static const uint32_t forever = UINT32_MAX;
+
+    // Bind to the calling task, the one that will wait(). Call it from setup().
+    // Returns false if that task does not run on gameCore, or shares it with the radio.
+    bool begin()
+    {
+        task = xTaskGetCurrentTaskHandle();
+        return xPortGetCoreID() == gameCore && gameCore != radioCore;
+    }
+
+    // Post events from another task, such as the ESP-NOW callbacks
+    void post(uint32_t events)
+    {
+        if (task)
+            xTaskNotify(task, events, eSetBits);
+    }
+
+    // Post events from an interrupt. Always inlined so it lands in the caller's IRAM section.
+    inline __attribute__((always_inline)) void postFromISR(uint32_t events)
+    {
+        if (!task)
+            return;
+
+        BaseType_t woken = pdFALSE;
+        xTaskNotifyFromISR(task, events, eSetBits, &woken);
+        if (woken)
+            portYIELD_FROM_ISR();
+    }
+
+    // Sleep until events are posted or timeoutMs elapses, then add them to the pending ones
+    void wait(uint32_t timeoutMs)
+    {
+        uint32_t received = 0;
+        TickType_t ticks = timeoutMs == forever ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+        if (xTaskNotifyWait(0, UINT32_MAX, &received, ticks) == pdTRUE)
+            pending |= received;
+    }
+
+    // Consume a pending event. Returns true if it was pending.
+    bool take(uint32_t events)
+    {
+        bool taken = pending & events;
+        pending &= ~events;
+        return taken;
+    }
+
+    uint32_t peek() const
+    {
+        return pending;
+    }
+
+private:
+    TaskHandle_t task = nullptr;
+    uint32_t pending = 0;
+};
+
+// Milliseconds left before more than duration has elapsed since start, for use as a wait() timeout
+inline uint32_t timeUntil(uint32_t start, uint32_t duration, uint32_t now)
+{
+    uint32_t elapsed = now - start;
+    return elapsed > duration ? 0 : duration + 1 - elapsed;
+}
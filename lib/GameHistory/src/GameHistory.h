@@ -0,0 +1,447 @@
+/*******************************************************************************
+History of the games played, kept in a raw flash partition as an append-only
+log.
+
+The partition is used as a ring of 4 KiB sectors. Each sector starts with a
+header holding an epoch, one more than the sector before it, and is followed
+by fixed-size records written in order; a record is only ever written once,
+over erased flash, and carries its own CRC, so one torn by a reset is simply
+skipped. The log runs from the oldest epoch to the head, and one sector is
+always kept erased ahead of it.
+
+When the head fills up, the spare sector becomes the new head. The oldest
+sector is then compacted: the high scores it still holds are copied into the
+new head and it is erased to become the next spare. The rest of its games are
+forgotten, so the history holds the last few thousand games plus the best
+ones ever played. A reset during compaction leaves copies behind, which are
+recognised by their game number, and begin() finishes the job.
+
+begin() reads the whole log once and keeps the TopCount best games in RAM,
+sorted, with the address of each: querying the high scores never touches the
+flash, and append() tells right away where a new game ranks.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <esp_partition.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// One game as stored in flash
+struct GameRecord
+{
+    uint32_t game;       // Number given by GameHistory, counting from 1
+    uint32_t durationMs; // From the start of the game to the winning guess
+    uint8_t mac[6];      // Winning remote
+    uint8_t difficulty;
+    uint8_t wrongGuesses;
+    uint16_t guesses;    // Of the winner, wrong ones included
+    uint16_t crc;        // CRC-16/CCITT-FALSE of the fields above
+};
+static_assert(sizeof(GameRecord) == 20, "GameRecord is a flash format; keep it packed");
+
+// Whether a is a better game than b: harder, then with fewer mistakes, then faster, then older
+inline bool betterGame(const GameRecord &a, const GameRecord &b)
+{
+    if (a.difficulty != b.difficulty)
+        return a.difficulty > b.difficulty;
+    if (a.wrongGuesses != b.wrongGuesses)
+        return a.wrongGuesses < b.wrongGuesses;
+    if (a.durationMs != b.durationMs)
+        return a.durationMs < b.durationMs;
+    return a.game < b.game;
+}
+
+// Largest number of sectors of the partition used for the history
+const uint32_t maxHistorySectors = 64;
+
+template <size_t TopCount>
+class GameHistory
+{
+public:
+    static const uint32_t sectorSize = 4096;
+    static const uint32_t magic = 0x31534847; // "GHS1"
+
+    struct SectorHeader
+    {
+        uint32_t magic;
+        uint32_t epoch;
+    };
+
+    static const uint16_t slotsPerSector = (sectorSize - sizeof(SectorHeader)) / sizeof(GameRecord);
+    static_assert(TopCount > 0 && TopCount < slotsPerSector, "The high scores of a sector must fit in a new one");
+
+    // Position in the log, for reading it from the oldest game to the newest
+    struct Cursor
+    {
+        uint32_t epoch;
+        uint16_t slot;
+    };
+
+    struct Stats
+    {
+        uint32_t erases;  // Sectors erased by compactions
+        uint32_t carried; // High scores copied out of compacted sectors
+    };
+
+    // Open the data partition with the given label and load the log, formatting the
+    // partition if it holds none. Returns false if it is missing, too small or unreadable.
+    bool begin(const char *label)
+    {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+        if (!partition)
+            return false;
+        sectorCount = partition->size / sectorSize;
+        if (sectorCount > maxHistorySectors)
+            sectorCount = maxHistorySectors;
+        if (sectorCount < 2)
+        {
+            partition = nullptr;
+            return false;
+        }
+
+        // The head is the sector with the newest epoch
+        bool found = false;
+        for (uint32_t sector = 0; sector < sectorCount; ++sector)
+        {
+            uint32_t epoch;
+            if (readEpoch(sector, epoch) && (!found || epoch > headEpoch))
+            {
+                headSector = sector;
+                headEpoch = epoch;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            usedSectors = 1;
+            if (openSector(0, 1) == ESP_OK)
+                return true;
+            partition = nullptr;
+            return false;
+        }
+
+        // The log runs back from it for as long as the epochs follow each other
+        usedSectors = 1;
+        while (usedSectors < sectorCount)
+        {
+            uint32_t epoch;
+            if (!readEpoch(sectorAt(usedSectors), epoch) || epoch != headEpoch - usedSectors)
+                break;
+            usedSectors++;
+        }
+
+        for (uint32_t age = usedSectors; age-- > 0;)
+        {
+            if (!loadSector(sectorAt(age), age == 0))
+            {
+                partition = nullptr;
+                return false;
+            }
+        }
+
+        // A reset came in the middle of a compaction
+        return usedSectors < sectorCount || compact() == ESP_OK;
+    }
+
+    // Number the record, store it and rank it. rank receives its place among the
+    // high scores, from 0, or -1 if it is not one.
+    esp_err_t append(GameRecord &record, int *rank = nullptr)
+    {
+        if (!partition)
+            return ESP_ERR_INVALID_STATE;
+        if (headSlot == slotsPerSector)
+        {
+            esp_err_t status = advance();
+            if (status != ESP_OK)
+                return status;
+        }
+
+        record.game = nextGame;
+        record.crc = recordCrc(record);
+        // The slot is used up even if the write fails half-way
+        uint32_t address = slotAddress(headSector, headSlot++);
+        esp_err_t status = esp_partition_write(partition, address, &record, sizeof(record));
+        if (status != ESP_OK)
+            return status;
+
+        nextGame++;
+        sectorRecords[headSector]++;
+        int place = insert(record, address);
+        if (rank)
+            *rank = place;
+        return ESP_OK;
+    }
+
+    // The high scores, best first
+    size_t highScores() const
+    {
+        return topSize;
+    }
+
+    const GameRecord &highScore(size_t rank) const
+    {
+        return top[rank].record;
+    }
+
+    // Where the oldest game of the log is
+    Cursor oldest() const
+    {
+        return {headEpoch + 1 - usedSectors, 0};
+    }
+
+    // Read the game at the cursor and move past it. Returns false at the end of the log.
+    // Games compacted away since the cursor was taken are skipped.
+    bool next(Cursor &cursor, GameRecord &record) const
+    {
+        if (!partition)
+            return false;
+
+        for (;;)
+        {
+            if (cursor.epoch < oldest().epoch)
+                cursor = oldest();
+            if (cursor.epoch > headEpoch || (cursor.epoch == headEpoch && cursor.slot >= headSlot))
+                return false;
+            if (cursor.slot == slotsPerSector)
+            {
+                cursor = {cursor.epoch + 1, 0};
+                continue;
+            }
+
+            uint32_t sector = sectorAt(headEpoch - cursor.epoch);
+            if (esp_partition_read(partition, slotAddress(sector, cursor.slot++), &record, sizeof(record)) != ESP_OK)
+                return false;
+            if (blank(record))
+                cursor.slot = slotsPerSector;
+            else if (valid(record))
+                return true;
+        }
+    }
+
+    // Games stored in the log, high scores carried over by compactions included
+    uint32_t size() const
+    {
+        uint32_t count = 0;
+        for (uint32_t age = 0; age < usedSectors; ++age)
+        {
+            count += sectorRecords[sectorAt(age)];
+        }
+        return count;
+    }
+
+    // Number of the last game appended, 0 if none was
+    uint32_t lastGame() const
+    {
+        return nextGame - 1;
+    }
+
+    uint32_t sectors() const
+    {
+        return partition ? sectorCount : 0;
+    }
+
+    const Stats &statistics() const
+    {
+        return stats;
+    }
+
+private:
+    struct Entry
+    {
+        GameRecord record;
+        uint32_t address; // Offset of the record in the partition
+    };
+
+    static uint16_t recordCrc(const GameRecord &record)
+    {
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(&record);
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < offsetof(GameRecord, crc); ++i)
+        {
+            crc ^= (uint16_t)data[i] << 8;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+            }
+        }
+        return crc;
+    }
+
+    // Erased flash reads as all ones
+    static bool blank(const GameRecord &record)
+    {
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(&record);
+        for (size_t i = 0; i < sizeof(record); ++i)
+        {
+            if (data[i] != 0xFF)
+                return false;
+        }
+        return true;
+    }
+
+    static bool valid(const GameRecord &record)
+    {
+        return record.crc == recordCrc(record);
+    }
+
+    // The sector age sectors before the head
+    uint32_t sectorAt(uint32_t age) const
+    {
+        return (headSector + sectorCount - age % sectorCount) % sectorCount;
+    }
+
+    static uint32_t slotAddress(uint32_t sector, uint16_t slot)
+    {
+        return sector * sectorSize + sizeof(SectorHeader) + slot * sizeof(GameRecord);
+    }
+
+    bool readEpoch(uint32_t sector, uint32_t &epoch) const
+    {
+        SectorHeader header;
+        if (esp_partition_read(partition, sector * sectorSize, &header, sizeof(header)) != ESP_OK || header.magic != magic)
+            return false;
+        epoch = header.epoch;
+        return true;
+    }
+
+    // Read the records of a sector into the high scores. Records are written in
+    // order, so the first blank slot ends the sector, and the head continues from there.
+    bool loadSector(uint32_t sector, bool head)
+    {
+        sectorRecords[sector] = 0;
+        uint16_t slot = 0;
+        for (; slot < slotsPerSector; ++slot)
+        {
+            GameRecord record;
+            uint32_t address = slotAddress(sector, slot);
+            if (esp_partition_read(partition, address, &record, sizeof(record)) != ESP_OK)
+                return false;
+            if (blank(record))
+                break;
+            if (!valid(record))
+                continue;
+
+            sectorRecords[sector]++;
+            insert(record, address);
+            if (record.game >= nextGame)
+                nextGame = record.game + 1;
+        }
+        if (head)
+            headSlot = slot;
+        return true;
+    }
+
+    // Erase a sector and make it the head
+    esp_err_t openSector(uint32_t sector, uint32_t epoch)
+    {
+        esp_err_t status = esp_partition_erase_range(partition, sector * sectorSize, sectorSize);
+        if (status != ESP_OK)
+            return status;
+        SectorHeader header = {magic, epoch};
+        status = esp_partition_write(partition, sector * sectorSize, &header, sizeof(header));
+        if (status != ESP_OK)
+            return status;
+
+        headSector = sector;
+        headEpoch = epoch;
+        headSlot = 0;
+        sectorRecords[sector] = 0;
+        return ESP_OK;
+    }
+
+    // Move the head to the spare sector, then compact the oldest one into it to get a spare back
+    esp_err_t advance()
+    {
+        // A compaction that failed must not leave the oldest sector to be erased with its high scores
+        if (usedSectors == sectorCount)
+        {
+            esp_err_t status = compact();
+            if (status != ESP_OK)
+                return status;
+        }
+
+        esp_err_t status = openSector((headSector + 1) % sectorCount, headEpoch + 1);
+        if (status != ESP_OK)
+            return status;
+        usedSectors++;
+        return usedSectors == sectorCount ? compact() : ESP_OK;
+    }
+
+    // Copy the high scores of the oldest sector to the head, then erase it
+    esp_err_t compact()
+    {
+        uint32_t oldestSector = sectorAt(usedSectors - 1);
+        uint32_t start = oldestSector * sectorSize;
+        for (size_t i = 0; i < topSize; ++i)
+        {
+            if (top[i].address < start || top[i].address >= start + sectorSize)
+                continue;
+            if (headSlot == slotsPerSector)
+                return ESP_ERR_NO_MEM;
+
+            uint32_t address = slotAddress(headSector, headSlot++);
+            esp_err_t status = esp_partition_write(partition, address, &top[i].record, sizeof(GameRecord));
+            if (status != ESP_OK)
+                return status;
+            top[i].address = address;
+            sectorRecords[headSector]++;
+            stats.carried++;
+        }
+
+        esp_err_t status = esp_partition_erase_range(partition, start, sectorSize);
+        if (status != ESP_OK)
+            return status;
+        stats.erases++;
+        sectorRecords[oldestSector] = 0;
+        usedSectors--;
+        return ESP_OK;
+    }
+
+    // Place a record among the high scores. Returns its rank, -1 if it is not one.
+    int insert(const GameRecord &record, uint32_t address)
+    {
+        // A copy made by a compaction replaces the original
+        for (size_t i = 0; i < topSize; ++i)
+        {
+            if (top[i].record.game == record.game)
+            {
+                top[i].address = address;
+                return i;
+            }
+        }
+
+        size_t rank = topSize;
+        while (rank > 0 && betterGame(record, top[rank - 1].record))
+        {
+            rank--;
+        }
+        if (rank == TopCount)
+            return -1;
+
+        size_t last = topSize < TopCount ? topSize++ : TopCount - 1;
+        for (size_t i = last; i > rank; --i)
+        {
+            top[i] = top[i - 1];
+        }
+        top[rank] = {record, address};
+        return rank;
+    }
+
+    const esp_partition_t *partition = nullptr;
+    uint32_t sectorCount = 0;
+    uint32_t usedSectors = 0; // Sectors from the oldest to the head; the others are spare
+    uint32_t headSector = 0;
+    uint32_t headEpoch = 0;
+    uint16_t headSlot = 0; // Next free slot of the head
+    uint16_t sectorRecords[maxHistorySectors] = {};
+    uint32_t nextGame = 1;
+
+    Entry top[TopCount] = {};
+    size_t topSize = 0;
+    Stats stats = {};
+};
@@ -0,0 +1,65 @@
+/*******************************************************************************
+ESP-NOW side of the protocol: peer registration, pairing storage, and the
+helpers both firmwares use on their receive path.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <esp_now.h>
+
+#include "GuessProtocol.h"
+
+// Frames sent to this address reach every node listening on the channel
+const uint8_t broadcastMacAddress[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// The manager registers the broadcast address as a peer too, which leaves one slot fewer for remotes
+const size_t maxRemotes = ESP_NOW_MAX_TOTAL_PEER_NUM - 1;
+
+// Preferences namespace in which a remote keeps the MAC address of its manager
+const char *const pairingNamespace = "pairing";
+
+const uint8_t espNowChannel = 1;
+
+// Register a node as an unencrypted peer on the game channel.
+// Returns ESP_ERR_ESPNOW_EXIST if it was already registered.
+inline esp_err_t addPeer(const uint8_t *mac)
+{
+    if (esp_now_is_peer_exist(mac))
+        return ESP_ERR_ESPNOW_EXIST;
+
+    esp_now_peer_info_t peerInfo = {};
+    memcpy(peerInfo.peer_addr, mac, ESP_NOW_ETH_ALEN);
+    peerInfo.channel = espNowChannel;
+    peerInfo.encrypt = false;
+    return esp_now_add_peer(&peerInfo);
+}
+
+// Copy a frame out of the ESP-NOW receive callback into a queue of ReceivedFrame.
+// Runs in the WiFi task, so it does nothing else.
+template <typename Queue>
+inline void queueFrame(Queue &queue, const uint8_t *mac, const uint8_t *data, int len)
+{
+    if (len <= 0 || len > (int)maxFrameLength)
+        return;
+
+    ReceivedFrame frame;
+    memcpy(frame.mac, mac, ESP_NOW_ETH_ALEN);
+    frame.len = len;
+    memcpy(frame.data, data, len);
+    frame.timestamp = micros();
+    queue.push(frame);
+}
+
+// Answer a received frame that requests it. Returns true if an ACK went to the radio,
+// which then reports its send status.
+inline bool sendAck(const uint8_t *mac, const FrameHeader &received)
+{
+    if (!(received.flags & FLAG_ACK_REQUEST))
+        return false;
+
+    uint8_t ack[frameHeaderLength];
+    return esp_now_send(mac, ack, encodeAck(ack, received)) == ESP_OK;
+}
@@ -0,0 +1,275 @@
+/*******************************************************************************
+ESP-NOW frame format shared by the game manager and the remotes.
+
+Every frame starts with a 6-byte header, followed by the payload:
+  byte 0    protocol version (high nibble) and flags (low nibble)
+  byte 1    frame type
+  bytes 2-3 sequence number, little endian
+  bytes 4-5 session id, little endian
+
+Data frames carry one application message. When flagged FLAG_ACK_REQUEST,
+the receiver answers with an ACK frame echoing their sequence number and
+session, and the sender retransmits them until that ACK arrives. Receivers
+remember recently seen sequence numbers, so a retransmitted duplicate is
+acknowledged again but processed only once.
+
+Each game is a new session chosen by the manager: sequence numbers restart
+with it, and frames left over from an older session are ignored.
+
+Remotes find the manager on their own. An unpaired remote broadcasts ANNOUNCE
+frames until a manager registers it as a peer and answers with a WELCOME
+frame; both sides keep the pairing in NVS, so it survives a reboot. Neither
+frame has a payload, and the header's sequence and session are unused.
+
+Data frames carry a single message byte: a command from the manager, or the
+number of the button pressed on a remote. It may be followed by a 32-bit
+microsecond value (little endian). For a guess it is a timestamp, which the
+manager copies into its verdict so the remote can measure round-trip
+latencies. For a game start it is the delay until the game begins: the start
+is broadcast once, then sent again to the remotes that missed it, and every
+remote begins at the same instant whichever copy it got. Decoding goes through 256-entry
+tables built at compile time, so validating a frame and turning a message
+into the receiver's signal is a couple of loads instead of a chain of
+comparisons.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+const uint8_t PROTOCOL_VERSION = 1;
+
+// Frame types
+const uint8_t FRAME_DATA = 0x01;
+const uint8_t FRAME_ACK = 0x02;
+const uint8_t FRAME_ANNOUNCE = 0x03; // Broadcast by a remote looking for a manager
+const uint8_t FRAME_WELCOME = 0x04;  // The manager's answer, once it registered the remote
+
+// Frame flags
+const uint8_t FLAG_ACK_REQUEST = 0x01;
+
+const size_t frameHeaderLength = 6;
+const size_t maxFrameLength = 32;
+const size_t maxPayloadLength = maxFrameLength - frameHeaderLength;
+const size_t messageFrameLength = frameHeaderLength + 1;
+const size_t stampLength = 4;
+const size_t stampedFrameLength = messageFrameLength + stampLength;
+
+// Commands sent by the manager to the remotes
+const uint8_t CMD_GAME_START = 0x01;
+const uint8_t CMD_GOOD_GUESS = 0x02;
+const uint8_t CMD_WRONG_GUESS = 0x03;
+const uint8_t CMD_GAME_WON = 0x04;
+const uint8_t CMD_GAME_OVER = 0x05; // Another remote won the game
+
+// Guesses sent by the remotes are the number of the pressed button, 1 to guessButtons
+const uint8_t guessButtons = 3;
+
+// Signals raised on a remote by the manager's commands, one bit each so they can pile up
+const uint8_t SIGNAL_GAME_START = 0x01;
+const uint8_t SIGNAL_GOOD_GUESS = 0x02;
+const uint8_t SIGNAL_WRONG_GUESS = 0x04;
+const uint8_t SIGNAL_GAME_WON = 0x08;
+const uint8_t SIGNAL_GAME_OVER = 0x10;
+
+// Lookup table indexed by any byte received over the air
+struct ByteTable
+{
+    uint8_t values[256];
+
+    constexpr uint8_t operator[](uint8_t index) const
+    {
+        return values[index];
+    }
+};
+
+// Shortest valid frame of each type; 0xFF rejects unknown types whatever their length
+constexpr ByteTable makeFrameMinLengths()
+{
+    ByteTable table = {};
+    for (int i = 0; i < 256; ++i)
+    {
+        table.values[i] = 0xFF;
+    }
+    table.values[FRAME_DATA] = messageFrameLength;
+    table.values[FRAME_ACK] = frameHeaderLength;
+    table.values[FRAME_ANNOUNCE] = frameHeaderLength;
+    table.values[FRAME_WELCOME] = frameHeaderLength;
+    return table;
+}
+constexpr ByteTable frameMinLengths = makeFrameMinLengths();
+
+// Signal raised by each command, 0 for unknown commands
+constexpr ByteTable makeCommandSignals()
+{
+    ByteTable table = {};
+    table.values[CMD_GAME_START] = SIGNAL_GAME_START;
+    table.values[CMD_GOOD_GUESS] = SIGNAL_GOOD_GUESS;
+    table.values[CMD_WRONG_GUESS] = SIGNAL_WRONG_GUESS;
+    table.values[CMD_GAME_WON] = SIGNAL_GAME_WON;
+    table.values[CMD_GAME_OVER] = SIGNAL_GAME_OVER;
+    return table;
+}
+constexpr ByteTable commandSignals = makeCommandSignals();
+
+// Button number carried by each guess, 0 for invalid guesses
+constexpr ByteTable makeGuessValues()
+{
+    ByteTable table = {};
+    for (uint8_t button = 1; button <= guessButtons; ++button)
+    {
+        table.values[button] = button;
+    }
+    return table;
+}
+constexpr ByteTable guessValues = makeGuessValues();
+
+static_assert(frameMinLengths[FRAME_DATA] == messageFrameLength, "data frames carry one message byte");
+static_assert(commandSignals[CMD_GAME_OVER] == SIGNAL_GAME_OVER && commandSignals[0] == 0, "command table");
+static_assert(guessValues[guessButtons] == guessButtons && guessValues[guessButtons + 1] == 0, "guess table");
+
+struct FrameHeader
+{
+    uint8_t type;
+    uint8_t flags;
+    uint16_t sequence;
+    uint16_t session;
+};
+
+// Write a frame into buffer, which must hold frameHeaderLength + payloadLength bytes.
+// Returns the frame length.
+inline size_t encodeFrame(uint8_t *buffer, const FrameHeader &header, const uint8_t *payload, size_t payloadLength)
+{
+    buffer[0] = (PROTOCOL_VERSION << 4) | (header.flags & 0x0F);
+    buffer[1] = header.type;
+    buffer[2] = header.sequence & 0xFF;
+    buffer[3] = header.sequence >> 8;
+    buffer[4] = header.session & 0xFF;
+    buffer[5] = header.session >> 8;
+    if (payloadLength > 0)
+    {
+        memcpy(buffer + frameHeaderLength, payload, payloadLength);
+    }
+    return frameHeaderLength + payloadLength;
+}
+
+// Write the ACK answering a received frame. Returns the frame length.
+inline size_t encodeAck(uint8_t *buffer, const FrameHeader &received)
+{
+    FrameHeader ack = {FRAME_ACK, 0, received.sequence, received.session};
+    return encodeFrame(buffer, ack, nullptr, 0);
+}
+
+// Write a frame of a type without payload, such as FRAME_ANNOUNCE. Returns the frame length.
+inline size_t encodeBare(uint8_t *buffer, uint8_t type)
+{
+    FrameHeader header = {type, 0, 0, 0};
+    return encodeFrame(buffer, header, nullptr, 0);
+}
+
+// Write a data frame carrying one message, to be acknowledged by the receiver. Returns the frame length.
+inline size_t encodeMessage(uint8_t *buffer, uint8_t message, uint16_t sequence, uint16_t session)
+{
+    buffer[0] = (PROTOCOL_VERSION << 4) | FLAG_ACK_REQUEST;
+    buffer[1] = FRAME_DATA;
+    buffer[2] = sequence & 0xFF;
+    buffer[3] = sequence >> 8;
+    buffer[4] = session & 0xFF;
+    buffer[5] = session >> 8;
+    buffer[6] = message;
+    return messageFrameLength;
+}
+
+// Write a data frame carrying one message and a timestamp. Returns the frame length.
+inline size_t encodeStampedMessage(uint8_t *buffer, uint8_t message, uint32_t stamp, uint16_t sequence, uint16_t session)
+{
+    encodeMessage(buffer, message, sequence, session);
+    buffer[7] = stamp & 0xFF;
+    buffer[8] = (stamp >> 8) & 0xFF;
+    buffer[9] = (stamp >> 16) & 0xFF;
+    buffer[10] = stamp >> 24;
+    return stampedFrameLength;
+}
+
+// Read the timestamp following the message byte of a data frame's payload. Returns false if there is none.
+inline bool readStamp(const uint8_t *payload, size_t payloadLength, uint32_t &stamp)
+{
+    if (payloadLength < 1 + stampLength)
+        return false;
+
+    stamp = payload[1] | (payload[2] << 8) | (payload[3] << 16) | ((uint32_t)payload[4] << 24);
+    return true;
+}
+
+// Parse a received frame. Returns false for truncated frames, unknown frame types
+// and other protocol versions; a data frame that passes carries at least one message byte.
+inline bool decodeFrame(const uint8_t *data, size_t len, FrameHeader &header, const uint8_t *&payload, size_t &payloadLength)
+{
+    if (len < frameHeaderLength || len > maxFrameLength)
+        return false;
+
+    header.flags = data[0] & 0x0F;
+    header.type = data[1];
+    header.sequence = data[2] | (data[3] << 8);
+    header.session = data[4] | (data[5] << 8);
+    payload = data + frameHeaderLength;
+    payloadLength = len - frameHeaderLength;
+    return ((data[0] >> 4) == PROTOCOL_VERSION) & (len >= frameMinLengths[header.type]);
+}
+
+// Remembers the last 32 sequence numbers received from one sender
+class DuplicateFilter
+{
+public:
+    void reset()
+    {
+        started = false;
+        seen = 0;
+    }
+
+    // Returns true the first time a sequence number is seen, false for duplicates.
+    // Numbers older than the window cannot be told apart and count as duplicates.
+    bool accept(uint16_t sequence)
+    {
+        if (!started)
+        {
+            started = true;
+            highest = sequence;
+            seen = 1;
+            return true;
+        }
+
+        int16_t ahead = (int16_t)(sequence - highest);
+        if (ahead > 0)
+        {
+            seen = ahead >= 32 ? 1 : (seen << ahead) | 1;
+            highest = sequence;
+            return true;
+        }
+
+        uint16_t behind = -ahead;
+        if (behind >= 32 || (seen & (1UL << behind)))
+            return false;
+
+        seen |= 1UL << behind;
+        return true;
+    }
+
+private:
+    bool started = false;
+    uint16_t highest = 0;
+    uint32_t seen = 0; // Bit n set when sequence highest - n was received
+};
+
+// A frame as received by the ESP-NOW callback, queued for loop() to process
+struct ReceivedFrame
+{
+    uint8_t mac[6];
+    uint8_t data[maxFrameLength];
+    uint8_t len;
+    uint32_t timestamp; // micros() at reception
+};
@@ -0,0 +1,164 @@
+/*******************************************************************************
+Host side of the input recordings: putting a dump back together from the log
+records it came as, decoding its entries, and the .inputs files keeping them.
+
+An .inputs file starts with the 8-byte magic "INPUTS1\n", followed by the
+recording exactly as the node held it (see InputFormat.h). Not meant for the
+firmwares.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <BinLogFormat.h>
+#include <LogEvents.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "InputFormat.h"
+
+const char inputsMagic[8] = {'I', 'N', 'P', 'U', 'T', 'S', '1', '\n'};
+
+struct InputEvent
+{
+    uint64_t time; // Microseconds since the boot, without wrapping around
+    uint8_t kind;
+    uint8_t source;
+    std::vector<uint8_t> payload;
+};
+
+// Decode the entries of a recording. Returns false if it ends in the middle of one.
+inline bool decodeInputs(const std::vector<uint8_t> &recording, std::vector<InputEvent> &events)
+{
+    uint64_t time = 0;
+    uint32_t lastStamp = 0;
+    size_t offset = 0;
+    while (offset + inputHeaderLength <= recording.size())
+    {
+        const uint8_t *entry = &recording[offset];
+        size_t length = entry[6];
+        if (entry[0] == 0 || offset + inputHeaderLength + length > recording.size())
+            return false;
+
+        uint32_t stamp = entry[1] | entry[2] << 8 | entry[3] << 16 | (uint32_t)entry[4] << 24;
+        // Entries recorded at about the same time from different contexts may be a little out of order
+        time = events.empty() ? stamp : time + (int32_t)(stamp - lastStamp);
+        lastStamp = stamp;
+        events.push_back({time, entry[0], entry[5], std::vector<uint8_t>(entry + inputHeaderLength, entry + inputHeaderLength + length)});
+        offset += inputHeaderLength + length;
+    }
+    return offset == recording.size();
+}
+
+// Puts a recording back together from the LOG_INPUT_CHUNK and LOG_INPUT_END records of
+// its dump, in any order. Chunks of an earlier dump of the same recording are fine too.
+class InputDumpAssembler
+{
+public:
+    // Take a record of the node's log; others are ignored
+    void add(const LogRecord &record)
+    {
+        if (record.id == LOG_INPUT_CHUNK && record.argCount == 4 && record.args[0] >= 0)
+        {
+            size_t offset = record.args[0];
+            size_t chunk = offset / chunkLength;
+            if (offset % chunkLength != 0)
+                return;
+            if (bytes.size() < offset + chunkLength)
+            {
+                bytes.resize(offset + chunkLength);
+                received.resize(chunk + 1);
+            }
+            for (int i = 0; i < 3; ++i)
+            {
+                uint32_t word = record.args[1 + i];
+                for (int j = 0; j < 4; ++j)
+                {
+                    bytes[offset + 4 * i + j] = word >> (8 * j);
+                }
+            }
+            received[chunk] = true;
+        }
+        else if (record.id == LOG_INPUT_END && record.argCount >= 2 && record.args[0] >= 0)
+        {
+            length = record.args[0];
+            dropped = record.args[1];
+            ended = true;
+        }
+    }
+
+    // Whether the end of the dump came in
+    bool finished() const
+    {
+        return ended;
+    }
+
+    // Chunks of the recording that never came, lost on the way or to a full log ring
+    size_t missingChunks() const
+    {
+        size_t chunks = (length + chunkLength - 1) / chunkLength;
+        size_t missing = 0;
+        for (size_t i = 0; i < chunks; ++i)
+        {
+            missing += i >= received.size() || !received[i];
+        }
+        return missing;
+    }
+
+    // The recording, once finished with no chunk missing
+    std::vector<uint8_t> recording() const
+    {
+        std::vector<uint8_t> result(bytes.begin(), bytes.begin() + std::min(length, bytes.size()));
+        result.resize(length);
+        return result;
+    }
+
+    // Inputs the node could not record, as it reported at the end of the dump
+    uint32_t droppedInputs() const
+    {
+        return dropped;
+    }
+
+private:
+    static const size_t chunkLength = 12;
+
+    std::vector<uint8_t> bytes;
+    std::vector<bool> received;
+    size_t length = 0;
+    uint32_t dropped = 0;
+    bool ended = false;
+};
+
+inline bool writeInputs(const char *path, const std::vector<uint8_t> &recording)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(inputsMagic, 1, sizeof(inputsMagic), file) == sizeof(inputsMagic) &&
+                   fwrite(recording.data(), 1, recording.size(), file) == recording.size();
+    return fclose(file) == 0 && written;
+}
+
+// Returns false if the file cannot be read or is not an .inputs file
+inline bool readInputs(const char *path, std::vector<uint8_t> &recording)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+    char magic[sizeof(inputsMagic)];
+    bool valid = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && !memcmp(magic, inputsMagic, sizeof(magic));
+    recording.clear();
+    uint8_t chunk[4096];
+    size_t read;
+    while (valid && (read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        recording.insert(recording.end(), chunk, chunk + read);
+    }
+    fclose(file);
+    return valid;
+}
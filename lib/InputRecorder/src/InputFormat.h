@@ -0,0 +1,34 @@
+/*******************************************************************************
+Format of the input recordings of InputRecorder.
+
+A recording is a sequence of entries, each an input of the node:
+  byte 0     kind (InputKind)
+  bytes 1-4  time the input came, esp_timer_get_time() in microseconds (u32)
+  byte 5     source: pin number, send status... depending on the kind
+  byte 6     length n of the payload
+  n bytes    payload
+All integers are little endian. The times wrap around after 71 minutes; the
+decoder counts the wraps, as entries are stored roughly in time order.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum InputKind : uint8_t
+{
+    INPUT_ENTROPY = 1,     // Hardware random value the node seeded itself with, payload u32
+    INPUT_NVS = 2,         // Entry read from NVS at boot, payload "namespace\0key\0" then its bytes
+    INPUT_PIN = 3,         // Level read on pin source, by an interrupt or at boot, payload u8
+    INPUT_FRAME = 4,       // ESP-NOW frame received, payload sender MAC then the frame
+    INPUT_SEND_STATUS = 5, // Status source of a frame sent, payload destination MAC
+    INPUT_SERIAL = 6,      // Bytes read from the host, stamped with the time they arrived
+    INPUT_READY = 7,       // End of setup(): inputs before it are the state the node booted with
+    INPUT_END = 8,         // End of the recording, payload the number of inputs dropped (u32)
+};
+
+const size_t inputHeaderLength = 7;
+const size_t maxInputPayload = 255;
@@ -0,0 +1,213 @@
+/*******************************************************************************
+Flight recorder of everything that comes into a node.
+
+The firmware records each input as it gets it: button edges in the ISRs,
+frames and send statuses in the ESP-NOW callbacks, commands from the host,
+and at boot the NVS entries and hardware entropy it starts from. Given the
+same inputs at the same times, the firmware does the same things, so the
+native simulation can run a recording through it again, as often and as
+fast as needed (see simulator/SimMain.cpp, --replay).
+
+A replay has to start from the boot, so entries are appended to a fixed
+buffer from then on; once it is full, recording stops and the inputs that
+did not fit are counted. Like BinLog, any context may record: space is
+claimed with a compare-and-swap on the fill level, and an entry is published
+by writing its kind byte last. The format is in InputFormat.h.
+
+startDump() closes the recording and continueDump() writes it out through
+BinLog, as LOG_INPUT_CHUNK records of 12 bytes tagged with their offset,
+followed by LOG_INPUT_END. InputCapture.h puts it back together on the host.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <esp_timer.h>
+#include <LogEvents.h>
+
+#include "InputFormat.h"
+
+template <size_t Capacity>
+class InputRecorder
+{
+    static_assert(Capacity > 2 * inputHeaderLength + 4, "Capacity too small for any entry");
+
+public:
+    // One piece of the payload of an entry, which may be gathered from several
+    struct Part
+    {
+        const void *data;
+        size_t length;
+    };
+
+    // Record an input of the given kind that came at time. Returns false if it did not fit.
+    bool record(uint8_t kind, uint8_t source, const Part *parts, size_t count, uint32_t time)
+    {
+        size_t length = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            length += parts[i].length;
+        }
+
+        // The other entries leave room for the end of the recording
+        size_t limit = kind == INPUT_END ? Capacity : Capacity - endLength;
+        size_t size = inputHeaderLength + length;
+        size_t start = used.load(std::memory_order_relaxed);
+        do
+        {
+            if (length > maxInputPayload || start + size > limit)
+            {
+                if (kind != INPUT_END && dropCount.fetch_add(1, std::memory_order_relaxed) == 0)
+                    firstDropAt.store(time, std::memory_order_relaxed);
+                return false;
+            }
+        } while (!used.compare_exchange_weak(start, start + size, std::memory_order_relaxed));
+
+        uint8_t *entry = buffer + start;
+        for (int i = 0; i < 4; ++i)
+        {
+            entry[1 + i] = time >> (8 * i);
+        }
+        entry[5] = source;
+        entry[6] = length;
+        uint8_t *payload = entry + inputHeaderLength;
+        for (size_t i = 0; i < count; ++i)
+        {
+            memcpy(payload, parts[i].data, parts[i].length);
+            payload += parts[i].length;
+        }
+        __atomic_store_n(entry, kind, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool record(uint8_t kind, uint8_t source, const void *payload = nullptr, size_t length = 0)
+    {
+        Part part = {payload, length};
+        return record(kind, source, &part, 1, esp_timer_get_time());
+    }
+
+    bool recordPin(uint8_t pin, uint8_t level)
+    {
+        return record(INPUT_PIN, pin, &level, sizeof(level));
+    }
+
+    bool recordFrame(const uint8_t *mac, const uint8_t *frame, size_t len)
+    {
+        Part parts[] = {{mac, 6}, {frame, len}};
+        return record(INPUT_FRAME, 0, parts, 2, esp_timer_get_time());
+    }
+
+    // An NVS entry the node booted with
+    bool recordNvs(const char *name, const char *key, const void *data, size_t len)
+    {
+        Part parts[] = {{name, strlen(name) + 1}, {key, strlen(key) + 1}, {data, len}};
+        return record(INPUT_NVS, 0, parts, 3, esp_timer_get_time());
+    }
+
+    // Bytes read from the host, which arrived at arrivedAt
+    bool recordSerial(const uint8_t *data, size_t len, uint32_t arrivedAt)
+    {
+        Part part = {data, len};
+        return record(INPUT_SERIAL, 0, &part, 1, arrivedAt);
+    }
+
+    // Close the recording with an INPUT_END entry: now, or when the first input was dropped
+    // if some were, as the inputs after that one are missing. There is room for it at least
+    // once; it can be closed again later, after more inputs. Returns false if it did not fit.
+    bool finish()
+    {
+        uint32_t drops = dropped();
+        uint32_t time = drops > 0 ? firstDropAt.load(std::memory_order_relaxed) : (uint32_t)esp_timer_get_time();
+        Part part = {&drops, sizeof(drops)};
+        return record(INPUT_END, 0, &part, 1, time);
+    }
+
+    // Close the recording and write it out from continueDump()
+    void startDump()
+    {
+        if (dumping)
+            return;
+        finish();
+        dumping = true;
+        dumpOffset = 0;
+        dumpEnd = used.load(std::memory_order_relaxed);
+    }
+
+    // Log the next chunks of the dump while the log ring has room for them and
+    // reserve more records. Returns true until the dump is over.
+    template <typename Log>
+    bool continueDump(Log &log, size_t reserve)
+    {
+        while (dumping && log.hasRoom(reserve + 1))
+        {
+            if (dumpOffset >= dumpEnd)
+            {
+                log.log(LOG_INPUT_END, dumpEnd, dropped());
+                dumping = false;
+                break;
+            }
+
+            // An entry claimed right before the end may still be written; its chunk waits for it
+            size_t chunkEnd = dumpOffset + chunkLength < dumpEnd ? dumpOffset + chunkLength : dumpEnd;
+            if (committed(chunkEnd) < chunkEnd)
+                break;
+
+            uint32_t words[chunkLength / 4] = {};
+            memcpy(words, buffer + dumpOffset, chunkEnd - dumpOffset);
+            log.log(LOG_INPUT_CHUNK, dumpOffset, words[0], words[1], words[2]);
+            dumpOffset += chunkLength;
+        }
+        return dumping;
+    }
+
+    bool dumpInProgress() const
+    {
+        return dumping;
+    }
+
+    // The recording so far, up to the entries still being written
+    const uint8_t *data() const
+    {
+        return buffer;
+    }
+
+    size_t size()
+    {
+        return committed(used.load(std::memory_order_relaxed));
+    }
+
+    // Inputs that did not fit, since startup
+    uint32_t dropped() const
+    {
+        return dropCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const size_t chunkLength = 12;
+    static const size_t endLength = inputHeaderLength + 4;
+
+    // Offset up to which the entries are all published, looking no further than limit
+    size_t committed(size_t limit)
+    {
+        while (publishedEnd < limit && __atomic_load_n(buffer + publishedEnd, __ATOMIC_ACQUIRE) != 0)
+        {
+            publishedEnd += inputHeaderLength + buffer[publishedEnd + 6];
+        }
+        return publishedEnd < limit ? publishedEnd : limit;
+    }
+
+    uint8_t buffer[Capacity] = {};
+    std::atomic<size_t> used{0};
+    std::atomic<uint32_t> dropCount{0};
+    std::atomic<uint32_t> firstDropAt{0};
+    size_t publishedEnd = 0;
+
+    bool dumping = false;
+    size_t dumpOffset = 0;
+    size_t dumpEnd = 0;
+};
@@ -0,0 +1,113 @@
+/*******************************************************************************
+Latency histogram with percentiles.
+
+Values are counted in log-linear buckets: each power of two is split into 16
+equal steps, so a bucket is never wider than 1/16 of the values it holds and
+percentiles are accurate to about 6%, from 1 to 2^32 with a fixed 1.8 kB of
+counters. Recording is a couple of shifts and an increment, cheap enough to do
+for every guess.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+class LatencyStats
+{
+public:
+    static const uint8_t subBucketBits = 4;
+    static const uint32_t subBuckets = 1 << subBucketBits;
+    static const size_t bucketCount = (32 - subBucketBits + 1) * subBuckets;
+
+    void record(uint32_t value)
+    {
+        counts[bucketOf(value)]++;
+        total++;
+        sum += value;
+        if (total == 1 || value < minimum)
+            minimum = value;
+        if (value > maximum)
+            maximum = value;
+    }
+
+    void reset()
+    {
+        memset(counts, 0, sizeof(counts));
+        total = 0;
+        sum = 0;
+        minimum = 0;
+        maximum = 0;
+    }
+
+    // Smallest value at or above the given fraction (0.5 for the median) of the
+    // recorded ones, rounded up to the top of its bucket. 0 when nothing was recorded.
+    uint32_t percentile(double fraction) const
+    {
+        if (total == 0)
+            return 0;
+
+        uint64_t rank = (uint64_t)(fraction * total);
+        if (rank < fraction * total || rank == 0)
+            rank++;
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucketCount; ++i)
+        {
+            seen += counts[i];
+            if (seen >= rank)
+                return upperBound(i) < maximum ? upperBound(i) : maximum;
+        }
+        return maximum;
+    }
+
+    uint32_t count() const
+    {
+        return total;
+    }
+
+    uint32_t min() const
+    {
+        return minimum;
+    }
+
+    uint32_t max() const
+    {
+        return maximum;
+    }
+
+    uint32_t mean() const
+    {
+        return total ? sum / total : 0;
+    }
+
+private:
+    // Values below subBuckets have a bucket each; above, the top subBucketBits + 1 bits pick the bucket
+    static size_t bucketOf(uint32_t value)
+    {
+        if (value < subBuckets)
+            return value;
+
+        uint8_t shift = (31 - __builtin_clz(value)) - subBucketBits;
+        return ((shift + 1) << subBucketBits) + ((value >> shift) - subBuckets);
+    }
+
+    static uint32_t upperBound(size_t bucket)
+    {
+        if (bucket < subBuckets)
+            return bucket;
+
+        uint8_t shift = (bucket >> subBucketBits) - 1;
+        uint32_t lower = ((bucket & (subBuckets - 1)) + subBuckets) << shift;
+        return lower + ((1UL << shift) - 1);
+    }
+
+    uint32_t counts[bucketCount] = {};
+    uint32_t total = 0;
+    uint64_t sum = 0;
+    uint32_t minimum = 0;
+    uint32_t maximum = 0;
+};
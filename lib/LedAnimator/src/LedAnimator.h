@@ -0,0 +1,102 @@
+/*******************************************************************************
+Non-blocking LED animations.
+
+An animation is a sequence of keyframes, each lighting a set of LEDs for a
+given time. update() moves to the keyframe due at the current time and
+returns right away, so the animation plays alongside the game logic instead
+of stalling it in delay(). nextUpdateIn() tells an event-driven loop when the
+next keyframe is due.
+
+Keyframe times are chained from the previous keyframe's scheduled time, not
+from the moment update() ran, so a late update does not stretch the whole
+animation.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+
+struct Keyframe
+{
+    uint8_t leds;      // Bit i lights LED i
+    uint16_t duration; // Milliseconds before the next keyframe
+};
+
+template <size_t LedCount>
+class LedAnimator
+{
+    static_assert(LedCount > 0 && LedCount <= 8, "A keyframe drives up to 8 LEDs");
+
+public:
+    static const uint32_t noUpdate = UINT32_MAX;
+
+    explicit LedAnimator(const uint8_t (&pins)[LedCount]) : pins(pins) {}
+
+    // Start an animation, replacing the one playing. The keyframes must outlive it.
+    template <size_t Count>
+    void play(const Keyframe (&keyframes)[Count], uint32_t now)
+    {
+        frames = keyframes;
+        frameCount = Count;
+        index = 0;
+        frameStart = now;
+        show(frames[0].leds);
+    }
+
+    // Leave the LEDs as they are and drop the animation
+    void stop()
+    {
+        frames = nullptr;
+    }
+
+    // Show the keyframe due at now. Returns true while the animation is playing.
+    bool update(uint32_t now)
+    {
+        while (frames && now - frameStart >= frames[index].duration)
+        {
+            frameStart += frames[index].duration;
+            if (++index == frameCount)
+            {
+                frames = nullptr;
+                break;
+            }
+            show(frames[index].leds);
+        }
+        return frames != nullptr;
+    }
+
+    bool playing() const
+    {
+        return frames != nullptr;
+    }
+
+    // Milliseconds until update() has a keyframe to show, noUpdate when nothing plays
+    uint32_t nextUpdateIn(uint32_t now) const
+    {
+        if (!frames)
+            return noUpdate;
+
+        uint32_t elapsed = now - frameStart;
+        return elapsed >= frames[index].duration ? 0 : frames[index].duration - elapsed;
+    }
+
+private:
+    void show(uint8_t leds)
+    {
+        for (size_t i = 0; i < LedCount; ++i)
+        {
+            digitalWrite(pins[i], (leds >> i) & 1 ? HIGH : LOW);
+        }
+    }
+
+    const uint8_t *pins;
+    const Keyframe *frames = nullptr;
+    size_t frameCount = 0;
+    size_t index = 0;
+    uint32_t frameStart = 0;
+};
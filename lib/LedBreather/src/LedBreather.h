@@ -0,0 +1,152 @@
+/*******************************************************************************
+Breathing effect on two LEDs, a quarter period apart like a sine and a cosine,
+faded by the LEDC peripheral.
+
+Each LED alternates between full fades up and down, each one run by the LEDC
+hardware fade engine, so the CPU only steps in twice per period and per LED to
+start the next fade. The fade end interrupt calls a user callback meant to
+wake the loop up; nextUpdateIn() gives the same deadline as a timeout, since
+that interrupt cannot wake the CPU from light sleep.
+
+The LEDC timer runs from the 8 MHz RTC oscillator, which is kept powered in
+light sleep, so the LEDs keep breathing while the CPU sleeps between fades.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <driver/ledc.h>
+#include <esp_sleep.h>
+
+class LedBreather
+{
+public:
+    static const uint32_t noUpdate = UINT32_MAX;
+
+    // The LEDs on pins[0] and pins[1] use LEDC channels firstChannel and firstChannel + 1
+    LedBreather(const uint8_t (&pins)[2], uint32_t periodMs, ledc_channel_t firstChannel = LEDC_CHANNEL_0)
+        : pins(pins), halfPeriod(periodMs / 2), firstChannel(firstChannel) {}
+
+    // Configure the LEDC timer and the fade engine. fadeEnd runs in the LEDC
+    // interrupt each time a fade ends. Returns false if the hardware refused it.
+    bool begin(ledc_cb_t fadeEnd, void *arg)
+    {
+        ledc_timer_config_t timer = {};
+        timer.speed_mode = mode;
+        timer.duty_resolution = LEDC_TIMER_8_BIT;
+        timer.timer_num = LEDC_TIMER_0;
+        timer.freq_hz = 5000;
+        timer.clk_cfg = LEDC_USE_RTC8M_CLK;
+        if (ledc_timer_config(&timer) != ESP_OK || ledc_fade_func_install(0) != ESP_OK)
+            return false;
+
+        esp_sleep_pd_config(ESP_PD_DOMAIN_RTC8M, ESP_PD_OPTION_ON);
+
+        ledc_cbs_t callbacks = {fadeEnd};
+        for (int i = 0; i < 2; ++i)
+        {
+            if (ledc_cb_register(mode, channel(i), &callbacks, arg) != ESP_OK)
+                return false;
+        }
+        return true;
+    }
+
+    // Route the pins to the LEDC and start breathing from the sine's zero crossing
+    void start(uint32_t now)
+    {
+        static const uint32_t startDuty[2] = {maxDuty / 2 + 1, maxDuty};
+
+        for (int i = 0; i < 2; ++i)
+        {
+            ledc_channel_config_t config = {};
+            config.gpio_num = pins[i];
+            config.speed_mode = mode;
+            config.channel = channel(i);
+            config.intr_type = LEDC_INTR_DISABLE;
+            config.timer_sel = LEDC_TIMER_0;
+            config.duty = startDuty[i];
+            ledc_channel_config(&config);
+        }
+
+        // The sine climbs to its peak in a quarter period, the cosine falls from it in half a period
+        fade(0, maxDuty, halfPeriod / 2, now);
+        fade(1, 0, halfPeriod, now);
+        breathing = true;
+    }
+
+    // Stop the outputs and give the pins back to the GPIO matrix, low
+    void stop()
+    {
+        breathing = false;
+        for (int i = 0; i < 2; ++i)
+        {
+            ledc_stop(mode, channel(i), 0);
+            pinMode(pins[i], OUTPUT);
+            digitalWrite(pins[i], LOW);
+        }
+    }
+
+    // Start the next fade of each LED whose fade is over. A fade started late
+    // is shortened by as much, so the two LEDs stay a quarter period apart.
+    void update(uint32_t now)
+    {
+        if (!breathing)
+            return;
+
+        for (int i = 0; i < 2; ++i)
+        {
+            uint32_t late = now - fadeEnd[i];
+            if ((int32_t)late < 0)
+                continue;
+            fade(i, target[i] ? 0 : maxDuty, late < halfPeriod ? halfPeriod - late : halfPeriod, now);
+        }
+    }
+
+    // Milliseconds until update() has a fade to start, noUpdate when not breathing
+    uint32_t nextUpdateIn(uint32_t now) const
+    {
+        if (!breathing)
+            return noUpdate;
+
+        uint32_t earliest = noUpdate;
+        for (int i = 0; i < 2; ++i)
+        {
+            int32_t remaining = (int32_t)(fadeEnd[i] - now);
+            if (remaining <= 0)
+                return 0;
+            if ((uint32_t)remaining < earliest)
+                earliest = remaining;
+        }
+        return earliest;
+    }
+
+    bool isBreathing() const
+    {
+        return breathing;
+    }
+
+private:
+    static const ledc_mode_t mode = LEDC_LOW_SPEED_MODE;
+    static const uint32_t maxDuty = (1 << 8) - 1;
+
+    ledc_channel_t channel(int index) const
+    {
+        return (ledc_channel_t)(firstChannel + index);
+    }
+
+    void fade(int index, uint32_t duty, uint32_t duration, uint32_t now)
+    {
+        target[index] = duty;
+        fadeEnd[index] = now + duration;
+        ledc_set_fade_time_and_start(mode, channel(index), duty, duration, LEDC_FADE_NO_WAIT);
+    }
+
+    const uint8_t *pins;
+    uint32_t halfPeriod;
+    ledc_channel_t firstChannel;
+    bool breathing = false;
+    uint32_t target[2] = {};
+    uint32_t fadeEnd[2] = {};
+};
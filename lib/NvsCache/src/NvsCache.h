@@ -0,0 +1,245 @@
+/*******************************************************************************
+Write-behind cache of NVS entries.
+
+Every entry binds a key of one Preferences namespace to a variable of the
+application, which reads and changes it like any other and calls touch()
+afterwards. Nothing is written then: poll() writes the changed entries once
+the application is idle and no change came for a while, or at the latest some
+time after the first unsaved change, so a burst of changes costs one write per
+entry and flash writes stay out of busy periods. Unchanged entries are never
+written. Like the Retransmitter, poll() is meant to be called from loop(), and
+nextPollIn() tells a loop that sleeps between events when it is due.
+
+restore() reads the entries back at boot, in the order they were bound, and
+gives up on the remaining ones once its time budget is spent, so a slow or
+corrupted flash cannot hold up the startup for long.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include <cstddef>
+#include <cstdint>
+
+template <size_t MaxEntries>
+class NvsCache
+{
+public:
+    struct Policy
+    {
+        uint32_t quietDelay; // Milliseconds without changes before an idle application is written
+        uint32_t maxDelay;   // Longest an unsaved change waits, idle or not
+    };
+
+    struct Stats
+    {
+        uint32_t touches; // Changes reported by the application
+        uint32_t writes;  // Entries written to flash
+        uint32_t commits; // Calls to poll() or flush() that wrote something
+    };
+
+    static const uint32_t noDeadline = UINT32_MAX;
+
+    NvsCache(const char *name, const Policy &policy) : name(name), policy(policy) {}
+
+    // Bind key to the capacity bytes at data. With a record size, the entry holds
+    // a variable number of records and touch() tells how many bytes are in use;
+    // otherwise it always holds capacity bytes. Returns false when the cache is full.
+    bool bind(const char *key, void *data, size_t capacity, size_t recordSize = 0)
+    {
+        if (count == MaxEntries)
+            return false;
+
+        entries[count++] = {key, static_cast<uint8_t *>(data), capacity, recordSize, recordSize ? 0 : capacity, false, false};
+        return true;
+    }
+
+    // Open the namespace and read the bound entries into their variables, until
+    // budgetUs is spent. Entries that are missing, have an unexpected length or
+    // come after the budget ran out keep their current value.
+    // Returns the number of entries restored.
+    size_t restore(uint32_t budgetUs)
+    {
+        if (!preferences.begin(name))
+            return 0;
+        opened = true;
+
+        uint32_t start = micros();
+        size_t restored = 0;
+        for (size_t i = 0; i < count && micros() - start < budgetUs; ++i)
+        {
+            Entry &entry = entries[i];
+            size_t length = preferences.getBytesLength(entry.key);
+            bool valid = entry.recordSize ? length % entry.recordSize == 0 && length <= entry.capacity
+                                          : length == entry.capacity;
+            if (length == 0 || !valid || preferences.getBytes(entry.key, entry.data, entry.capacity) != length)
+                continue;
+
+            entry.length = length;
+            entry.restored = true;
+            restored++;
+        }
+        return restored;
+    }
+
+    // The variable bound at data changed
+    void touch(const void *data, uint32_t now)
+    {
+        Entry *entry = find(data);
+        if (entry)
+            markDirty(*entry, now);
+    }
+
+    // The variable-length entry bound at data changed and now holds length bytes
+    void touch(const void *data, size_t length, uint32_t now)
+    {
+        Entry *entry = find(data);
+        if (!entry || length > entry->capacity)
+            return;
+        entry->length = length;
+        markDirty(*entry, now);
+    }
+
+    // Bytes in use in the entry bound at data, as restored or last touched
+    size_t length(const void *data) const
+    {
+        const Entry *entry = const_cast<NvsCache *>(this)->find(data);
+        return entry ? entry->length : 0;
+    }
+
+    // Call f(name, key, data, length) for each entry restore() read back, with its namespace
+    template <typename Function>
+    void forEachRestored(Function f) const
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (entries[i].restored)
+                f(name, entries[i].key, entries[i].data, entries[i].length);
+        }
+    }
+
+    // Write the changed entries if they are due. Returns the number of entries written.
+    size_t poll(uint32_t now, bool idle)
+    {
+        if (nextPollIn(now, idle) > 0)
+            return 0;
+        return flush();
+    }
+
+    // Write the changed entries right away, before a restart for instance.
+    // Returns the number of entries written.
+    size_t flush()
+    {
+        if (!opened || !pending)
+            return 0;
+
+        size_t written = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            Entry &entry = entries[i];
+            if (!entry.dirty)
+                continue;
+
+            // An empty blob cannot be written, so an entry emptied of its records is removed
+            bool ok = entry.length > 0 ? preferences.putBytes(entry.key, entry.data, entry.length) == entry.length
+                                       : preferences.remove(entry.key) || !preferences.isKey(entry.key);
+            if (ok)
+            {
+                entry.dirty = false;
+                written++;
+            }
+        }
+        stats.writes += written;
+        stats.commits++;
+
+        // Entries that failed are tried again after another full delay
+        pending = false;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (entries[i].dirty && !pending)
+            {
+                pending = true;
+                firstChange = lastChange = millis();
+            }
+        }
+        return written;
+    }
+
+    // Milliseconds until poll() has something to write, noDeadline if nothing changed.
+    // An application that is not idle only has to come back for the longest delay.
+    uint32_t nextPollIn(uint32_t now, bool idle) const
+    {
+        if (!pending)
+            return noDeadline;
+
+        uint32_t sinceFirst = now - firstChange;
+        uint32_t untilForced = sinceFirst >= policy.maxDelay ? 0 : policy.maxDelay - sinceFirst;
+        if (!idle)
+            return untilForced;
+
+        uint32_t sinceLast = now - lastChange;
+        uint32_t untilQuiet = sinceLast >= policy.quietDelay ? 0 : policy.quietDelay - sinceLast;
+        return untilQuiet < untilForced ? untilQuiet : untilForced;
+    }
+
+    bool dirty() const
+    {
+        return pending;
+    }
+
+    const Stats &statistics() const
+    {
+        return stats;
+    }
+
+private:
+    struct Entry
+    {
+        const char *key;
+        uint8_t *data;
+        size_t capacity;
+        size_t recordSize;
+        size_t length;
+        bool dirty;
+        bool restored;
+    };
+
+    Entry *find(const void *data)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (entries[i].data == data)
+                return &entries[i];
+        }
+        return nullptr;
+    }
+
+    void markDirty(Entry &entry, uint32_t now)
+    {
+        stats.touches++;
+        entry.dirty = true;
+        if (!pending)
+        {
+            pending = true;
+            firstChange = now;
+        }
+        lastChange = now;
+    }
+
+    const char *name;
+    Policy policy;
+    Preferences preferences;
+    bool opened = false;
+
+    Entry entries[MaxEntries] = {};
+    size_t count = 0;
+
+    bool pending = false;     // Some entry changed since it was last written
+    uint32_t firstChange = 0; // millis() of the oldest unsaved change
+    uint32_t lastChange = 0;  // millis() of the latest change
+    Stats stats = {};
+};
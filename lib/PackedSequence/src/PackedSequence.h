@@ -0,0 +1,80 @@
+/*******************************************************************************
+Sequence of small values, packed two bits each.
+
+The guessing game only ever stores button numbers 1-3, so four steps fit in
+a byte: a sequence of thousands of steps takes a few hundred bytes, and
+reading any step is a shift and a mask.
+
+Values are drawn lazily: reset() only sets the length, and at() draws the
+steps up to the one asked for the first time it is reached, then keeps them
+so the sequence can be played again from the start. A game that ends early
+never pays for the rest of a long sequence. Steps not drawn yet or past the
+length read as 0, which no button matches.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+template <size_t MaxLength>
+class PackedSequence
+{
+    static_assert(MaxLength > 0, "A sequence holds at least one step");
+
+public:
+    static const size_t capacity = MaxLength;
+    static const uint8_t maxValue = 3;
+
+    // Start a new sequence of length steps, none of them drawn yet.
+    // Longer sequences are cut to the capacity.
+    void reset(size_t length)
+    {
+        count = length < MaxLength ? length : MaxLength;
+        drawnCount = 0;
+    }
+
+    // The value at step i, drawing it and the steps before it from next(),
+    // which returns values 0-3, if they were not drawn yet. 0 past the end.
+    template <typename Generator>
+    uint8_t at(size_t i, Generator next)
+    {
+        if (i >= count)
+            return 0;
+        for (; drawnCount <= i; ++drawnCount)
+        {
+            uint8_t &byte = bytes[drawnCount >> 2];
+            byte = (byte & ~(maxValue << shift(drawnCount))) | (next() & maxValue) << shift(drawnCount);
+        }
+        return (*this)[i];
+    }
+
+    // The value at step i if it was drawn, 0 otherwise
+    uint8_t operator[](size_t i) const
+    {
+        return i < drawnCount ? (bytes[i >> 2] >> shift(i)) & maxValue : 0;
+    }
+
+    size_t length() const
+    {
+        return count;
+    }
+
+    // Steps drawn so far, from the first
+    size_t drawn() const
+    {
+        return drawnCount;
+    }
+
+private:
+    static unsigned shift(size_t i)
+    {
+        return (i & 3) * 2;
+    }
+
+    uint8_t bytes[(MaxLength + 3) / 4] = {};
+    size_t count = 0;
+    size_t drawnCount = 0;
+};
@@ -0,0 +1,145 @@
+/*******************************************************************************
+Fixed-capacity table of per-peer state, keyed by MAC address.
+
+Entries live in an open-addressed hash table with linear probing, sized to
+at least twice the capacity so probe sequences stay short: finding the
+sender of a received frame costs a hash and one or two comparisons, however
+many peers there are. Removal shifts the following entries back instead of
+leaving tombstones, so lookups never slow down as peers come and go. No
+allocation happens after construction.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+template <typename Value, size_t Capacity>
+class PeerTable
+{
+    static constexpr size_t slotCountFor(size_t capacity)
+    {
+        size_t slots = 1;
+        while (slots < 2 * capacity)
+        {
+            slots <<= 1;
+        }
+        return slots;
+    }
+
+public:
+    static const size_t macLength = 6;
+    static const size_t slotCount = slotCountFor(Capacity);
+
+    // The state of a peer, or nullptr if it is not in the table
+    Value *find(const uint8_t *mac)
+    {
+        for (size_t i = home(mac);; i = (i + 1) & mask)
+        {
+            if (!slots[i].used)
+                return nullptr;
+            if (!memcmp(slots[i].mac, mac, macLength))
+                return &slots[i].value;
+        }
+    }
+
+    const Value *find(const uint8_t *mac) const
+    {
+        return const_cast<PeerTable *>(this)->find(mac);
+    }
+
+    // The state of a peer, added with a default-constructed value if it was not in the
+    // table yet. Returns nullptr when the table is full.
+    Value *insert(const uint8_t *mac)
+    {
+        size_t i = home(mac);
+        for (; slots[i].used; i = (i + 1) & mask)
+        {
+            if (!memcmp(slots[i].mac, mac, macLength))
+                return &slots[i].value;
+        }
+        if (count == Capacity)
+            return nullptr;
+
+        slots[i].used = true;
+        memcpy(slots[i].mac, mac, macLength);
+        slots[i].value = Value();
+        count++;
+        return &slots[i].value;
+    }
+
+    bool remove(const uint8_t *mac)
+    {
+        size_t i = home(mac);
+        for (;; i = (i + 1) & mask)
+        {
+            if (!slots[i].used)
+                return false;
+            if (!memcmp(slots[i].mac, mac, macLength))
+                break;
+        }
+
+        // Move back every following entry that the hole would make unreachable
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask)
+        {
+            size_t wanted = home(slots[j].mac);
+            if (((j - wanted) & mask) >= ((j - hole) & mask))
+            {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole].used = false;
+        count--;
+        return true;
+    }
+
+    // Call visit(mac, value) for every peer, in no particular order
+    template <typename Visitor>
+    void forEach(Visitor visit)
+    {
+        for (Slot &slot : slots)
+        {
+            if (slot.used)
+                visit(static_cast<const uint8_t *>(slot.mac), slot.value);
+        }
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool full() const
+    {
+        return count == Capacity;
+    }
+
+private:
+    static const size_t mask = slotCount - 1;
+
+    struct Slot
+    {
+        bool used = false;
+        uint8_t mac[macLength];
+        Value value;
+    };
+
+    // Boards of a batch share their first bytes: hash the whole address anyway
+    static size_t home(const uint8_t *mac)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < macLength; ++i)
+        {
+            hash = (hash ^ mac[i]) * 16777619u;
+        }
+        return (hash ^ (hash >> 16)) & mask;
+    }
+
+    Slot slots[slotCount];
+    size_t count = 0;
+};
@@ -0,0 +1,132 @@
+/*******************************************************************************
+CPU frequency scaled to what the node is doing.
+
+The power management lets the clock drop to minFreqMhz whenever no lock asks
+for more. The WiFi driver holds its own lock on the APB frequency while the
+radio listens, which keeps the CPU at 80 MHz at least and ESP-NOW working;
+boost() takes a ESP_PM_CPU_FREQ_MAX lock on top for the stretches where
+latency matters, and gives it back after. The locks of every user add up, so
+this coexists with the WiFi driver and with any other task boosting too.
+
+The switch happens in esp_pm_lock_acquire() on the calling core, which waits
+for the new clock to settle: its duration is the latency a boost adds, timed
+on every switch. The time spent boosted and scaled down is tallied as well.
+
+Without CONFIG_PM_ENABLE, begin() reports ESP_ERR_NOT_SUPPORTED and the CPU
+stays at the frequency it booted with; scaling() is false and boost() does
+nothing, so no switch or time is reported that did not happen.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <Arduino.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+
+#include <cstdint>
+
+struct BoostConfig
+{
+    int maxFreqMhz = 240; // While boosted
+    int minFreqMhz = 80;  // Otherwise, unless another lock asks for more
+};
+
+class CpuBoost
+{
+public:
+    explicit CpuBoost(const BoostConfig &config) : config(config) {}
+
+    // Call once in setup(), before boosting. Returns the first error, the settings before it being applied.
+    esp_err_t begin()
+    {
+        since = esp_timer_get_time();
+        esp_pm_config_esp32_t pm = {};
+        pm.max_freq_mhz = config.maxFreqMhz;
+        pm.min_freq_mhz = config.minFreqMhz;
+        pm.light_sleep_enable = false;
+        esp_err_t err = esp_pm_configure(&pm);
+        if (err == ESP_OK)
+            err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "boost", &lock);
+        return err;
+    }
+
+    // Ask for the maximum frequency or give it back. Returns true when this switched.
+    bool boost(bool on)
+    {
+        if (!lock || on == boosted)
+            return false;
+
+        uint64_t start = esp_timer_get_time();
+        if (on)
+            esp_pm_lock_acquire(lock);
+        else
+            esp_pm_lock_release(lock);
+        uint64_t now = esp_timer_get_time();
+        switchUs = now - start;
+        if (switchUs > maxSwitchUs)
+            maxSwitchUs = switchUs;
+        switchCount++;
+
+        (boosted ? boostedUs : scaledUs) += now - since;
+        since = now;
+        boosted = on;
+        return true;
+    }
+
+    // Whether begin() succeeded, and boost() switches the frequency
+    bool scaling() const
+    {
+        return lock != nullptr;
+    }
+
+    bool isBoosted() const
+    {
+        return boosted;
+    }
+
+    // Time the last switch took, and the longest since startup, in us
+    uint32_t lastSwitchUs() const
+    {
+        return switchUs;
+    }
+
+    uint32_t longestSwitchUs() const
+    {
+        return maxSwitchUs;
+    }
+
+    uint32_t switches() const
+    {
+        return switchCount;
+    }
+
+    // Time spent boosted or not since begin(), up to now, in us
+    uint64_t timeBoostedUs() const
+    {
+        return boostedUs + (boosted ? elapsed() : 0);
+    }
+
+    uint64_t timeScaledUs() const
+    {
+        return scaledUs + (boosted ? 0 : elapsed());
+    }
+
+private:
+    uint64_t elapsed() const
+    {
+        return esp_timer_get_time() - since;
+    }
+
+    const BoostConfig config;
+    esp_pm_lock_handle_t lock = nullptr;
+    bool boosted = false;
+
+    uint64_t since = 0; // esp_timer_get_time() of the last switch, or of begin()
+    uint64_t boostedUs = 0;
+    uint64_t scaledUs = 0;
+    uint32_t switchUs = 0;
+    uint32_t maxSwitchUs = 0;
+    uint32_t switchCount = 0;
+};
@@ -0,0 +1,101 @@
+/*******************************************************************************
+Light sleep between events for a battery-powered node.
+
+An event-driven loop leaves the CPU idle nearly all the time, but idle is
+still a full clock. With automatic light sleep, the power management puts the
+chip to sleep whenever every task is blocked, and wakes it for the next
+timer: the FreeRTOS ticks, the esp_timers, the timeouts of loop()'s wait.
+
+Whatever else must wake it has to be set up for it:
+- Buttons wake it through their RTC IO, on the pressed level. The wake does
+  not replace their interrupts, which see the edge once the chip is up.
+- The radio goes into modem sleep and wakes every radioWakeIntervalMs for
+  radioWakeWindowMs to receive ESP-NOW frames. Frames that come while it
+  sleeps are missed, so a shorter window saves more power but delays the
+  frames of the other node until a retransmission hits the window.
+  radioDelayUs() gives the worst case. With a window as long as the
+  interval, the radio always listens.
+
+Light sleep needs CONFIG_PM_ENABLE and CONFIG_FREERTOS_USE_TICKLESS_IDLE in
+the sdkconfig; without them, begin() reports ESP_ERR_NOT_SUPPORTED and the
+node simply stays awake.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <driver/rtc_io.h>
+#include <esp_now.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_wifi.h>
+
+#include <cstddef>
+#include <cstdint>
+
+struct PowerConfig
+{
+    bool lightSleep;              // false keeps the chip and the radio awake
+    uint16_t radioWakeIntervalMs; // The radio listens radioWakeWindowMs out of every radioWakeIntervalMs
+    uint16_t radioWakeWindowMs;
+    int maxFreqMhz = 240;
+    int minFreqMhz = 80; // The CPU clock scales down to this when no task needs it faster
+};
+
+template <size_t WakePins>
+class PowerManager
+{
+public:
+    // The pins are active low buttons, as with INPUT_PULLUP
+    PowerManager(const uint8_t (&wakePins)[WakePins], const PowerConfig &config) : wakePins(wakePins), config(config) {}
+
+    // Call once ESP-NOW is initialised. Returns the first error, the settings before it being applied.
+    esp_err_t begin()
+    {
+        if (!config.lightSleep)
+            return esp_wifi_set_ps(WIFI_PS_NONE);
+
+        for (size_t i = 0; i < WakePins; ++i)
+        {
+            esp_err_t err = rtc_gpio_wakeup_enable((gpio_num_t)wakePins[i], GPIO_INTR_LOW_LEVEL);
+            if (err != ESP_OK)
+                return err;
+        }
+        esp_err_t err = esp_sleep_enable_gpio_wakeup();
+        if (err != ESP_OK)
+            return err;
+
+        // The wake window only applies under power save
+        err = esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+        if (err == ESP_OK)
+            err = esp_wifi_connectionless_module_set_wake_interval(config.radioWakeIntervalMs);
+        if (err == ESP_OK)
+            err = esp_now_set_wake_window(config.radioWakeWindowMs);
+        if (err != ESP_OK)
+            return err;
+
+        esp_pm_config_esp32_t pm = {};
+        pm.max_freq_mhz = config.maxFreqMhz;
+        pm.min_freq_mhz = config.minFreqMhz;
+        pm.light_sleep_enable = true;
+        return esp_pm_configure(&pm);
+    }
+
+    bool lightSleep() const
+    {
+        return config.lightSleep;
+    }
+
+    // Longest a frame sent to this node may wait for its radio to listen, in us: 0 when it always does
+    uint32_t radioDelayUs() const
+    {
+        if (!config.lightSleep || config.radioWakeWindowMs >= config.radioWakeIntervalMs)
+            return 0;
+        return (config.radioWakeIntervalMs - config.radioWakeWindowMs) * 1000;
+    }
+
+private:
+    const uint8_t (&wakePins)[WakePins];
+    const PowerConfig config;
+};
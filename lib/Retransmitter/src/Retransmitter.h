@@ -0,0 +1,233 @@
+/*******************************************************************************
+Non-blocking retransmission scheduler.
+
+Messages stay in a bounded in-flight window until they are acknowledged. Each
+one has its own retry timer whose delay doubles after every attempt, and is
+abandoned once it runs out of attempts. Nothing here blocks: poll() is meant
+to be called from loop() and only resends what is due, and nextPollIn() tells
+a loop that sleeps between events when it has to wake up for that.
+
+The ESP-NOW send callback reports statuses in the order frames were handed to
+the radio, so every accepted transmission is also recorded in a FIFO that
+matchSendStatus() consumes to tell which message a status belongs to. Frames
+sent around the window, such as ACKs, must be recorded with sentUntracked()
+to keep the two in step.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+template <size_t Window, size_t MaxLength>
+class Retransmitter
+{
+    static_assert(Window > 0 && (Window & (Window - 1)) == 0, "Window must be a power of two");
+
+public:
+    // Hands a frame to the radio, returning false if it was rejected
+    typedef bool (*SendFunction)(const uint8_t *mac, const uint8_t *data, size_t len);
+
+    struct Config
+    {
+        uint32_t initialDelay; // Milliseconds before the first retry
+        uint32_t maxDelay;     // Cap of the exponential backoff
+        uint8_t maxAttempts;   // Transmissions, including the first one, before giving up
+    };
+
+    struct Stats
+    {
+        uint32_t transmissions;
+        uint32_t retransmissions;
+        uint32_t acknowledged;
+        uint32_t abandoned;
+    };
+
+    static const int32_t noMessage = -1;
+    static const uint32_t noDeadline = UINT32_MAX;
+
+    Retransmitter(SendFunction send, const Config &config) : send(send), config(config) {}
+
+    // Queue a message and send its first attempt right away.
+    // Returns false if the window is full or the message is too long.
+    bool submit(uint16_t id, const uint8_t *mac, const uint8_t *data, size_t len, uint32_t now)
+    {
+        if (len > MaxLength)
+            return false;
+
+        for (Entry &entry : entries)
+        {
+            if (entry.used)
+                continue;
+
+            entry.used = true;
+            entry.id = id;
+            memcpy(entry.mac, mac, sizeof(entry.mac));
+            memcpy(entry.data, data, len);
+            entry.len = len;
+            entry.attempts = 0;
+            transmit(entry, now);
+            return true;
+        }
+        return false;
+    }
+
+    // The message reached its destination: stop retrying it
+    bool acknowledge(uint16_t id)
+    {
+        Entry *entry = find(id);
+        if (!entry)
+            return false;
+
+        entry->used = false;
+        stats.acknowledged++;
+        return true;
+    }
+
+    // A frame outside of the window was handed to the radio: its status belongs to no message
+    void sentUntracked()
+    {
+        recordStatus(noMessage);
+    }
+
+    // Match a send callback status with the transmission it belongs to.
+    // Returns the message id, or noMessage if no transmission was pending.
+    int32_t matchSendStatus()
+    {
+        if (statusHead == statusTail)
+            return noMessage;
+        return pendingStatus[statusHead++ % statusCapacity];
+    }
+
+    // Resend every message whose timer expired. Returns the number of messages
+    // abandoned during this call, the last of them being reported by lastAbandoned().
+    uint8_t poll(uint32_t now)
+    {
+        uint8_t abandoned = 0;
+        for (Entry &entry : entries)
+        {
+            if (!entry.used || (int32_t)(now - entry.deadline) < 0)
+                continue;
+
+            if (entry.attempts >= config.maxAttempts)
+            {
+                entry.used = false;
+                lastAbandonedId = entry.id;
+                stats.abandoned++;
+                abandoned++;
+                continue;
+            }
+
+            stats.retransmissions++;
+            transmit(entry, now);
+        }
+        return abandoned;
+    }
+
+    // Milliseconds until poll() has a message to resend or abandon, noDeadline if none is in flight
+    uint32_t nextPollIn(uint32_t now) const
+    {
+        uint32_t earliest = noDeadline;
+        for (const Entry &entry : entries)
+        {
+            if (!entry.used)
+                continue;
+
+            int32_t remaining = (int32_t)(entry.deadline - now);
+            if (remaining <= 0)
+                return 0;
+            if ((uint32_t)remaining < earliest)
+                earliest = remaining;
+        }
+        return earliest;
+    }
+
+    bool pending(uint16_t id) const
+    {
+        return find(id) != nullptr;
+    }
+
+    size_t inFlight() const
+    {
+        size_t count = 0;
+        for (const Entry &entry : entries)
+        {
+            count += entry.used;
+        }
+        return count;
+    }
+
+    uint16_t lastAbandoned() const
+    {
+        return lastAbandonedId;
+    }
+
+    const Stats &statistics() const
+    {
+        return stats;
+    }
+
+private:
+    struct Entry
+    {
+        bool used = false;
+        uint16_t id;
+        uint8_t mac[6];
+        uint8_t data[MaxLength];
+        size_t len;
+        uint8_t attempts;
+        uint32_t deadline;
+    };
+
+    // Every in-flight message may have a couple of statuses outstanding, and as many untracked frames
+    static const size_t statusCapacity = Window * 4;
+
+    void transmit(Entry &entry, uint32_t now)
+    {
+        uint32_t delay = config.maxDelay;
+        if (entry.attempts < 16 && (config.initialDelay << entry.attempts) < config.maxDelay)
+            delay = config.initialDelay << entry.attempts;
+
+        entry.attempts++;
+        entry.deadline = now + delay;
+        stats.transmissions++;
+
+        // A rejected frame never gets a status; its timer retries it later
+        if (send(entry.mac, entry.data, entry.len))
+            recordStatus(entry.id);
+    }
+
+    void recordStatus(int32_t id)
+    {
+        if (statusTail - statusHead == statusCapacity)
+            statusHead++;
+        pendingStatus[statusTail++ % statusCapacity] = id;
+    }
+
+    Entry *find(uint16_t id)
+    {
+        for (Entry &entry : entries)
+        {
+            if (entry.used && entry.id == id)
+                return &entry;
+        }
+        return nullptr;
+    }
+
+    const Entry *find(uint16_t id) const
+    {
+        return const_cast<Retransmitter *>(this)->find(id);
+    }
+
+    SendFunction send;
+    Config config;
+    Entry entries[Window];
+    int32_t pendingStatus[statusCapacity];
+    uint32_t statusHead = 0;
+    uint32_t statusTail = 0;
+    uint16_t lastAbandonedId = 0;
+    Stats stats = {};
+};
@@ -0,0 +1,93 @@
+/*******************************************************************************
+Random number sources for the game sequences.
+
+RandomSource is the interface the game draws from. Two sources implement it:
+Pcg32, a small fast generator (PCG-XSH-RR) whose output is fully determined
+by its seed, for benchmarks and replays that must play the same sequences
+again, and HardwareRandom, which reads the ESP32's hardware RNG for real
+games.
+
+below() draws an integer under a bound without the bias of a plain modulo:
+it multiplies a 32-bit draw by the bound and keeps the high word (Lemire's
+method), drawing again in the rare cases that would favour some values.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <esp_random.h>
+
+#include <cstdint>
+
+class RandomSource
+{
+public:
+    virtual ~RandomSource() = default;
+
+    // A uniformly distributed 32-bit value
+    virtual uint32_t next() = 0;
+
+    // A uniformly distributed value in [0, bound); bound must not be 0
+    uint32_t below(uint32_t bound)
+    {
+        uint64_t product = (uint64_t)next() * bound;
+        uint32_t low = (uint32_t)product;
+        if (low < bound)
+        {
+            // 2^32 mod bound values of low would give some results one extra chance
+            uint32_t threshold = -bound % bound;
+            while (low < threshold)
+            {
+                product = (uint64_t)next() * bound;
+                low = (uint32_t)product;
+            }
+        }
+        return product >> 32;
+    }
+};
+
+class Pcg32 : public RandomSource
+{
+public:
+    explicit Pcg32(uint64_t initialState, uint64_t stream = defaultStream)
+    {
+        seed(initialState, stream);
+    }
+
+    // Restart the generator. Generators on different streams never share their outputs.
+    void seed(uint64_t initialState, uint64_t stream = defaultStream)
+    {
+        state = 0;
+        increment = (stream << 1) | 1;
+        next();
+        state += initialState;
+        next();
+    }
+
+    uint32_t next() override
+    {
+        uint64_t previous = state;
+        state = previous * multiplier + increment;
+        uint32_t shifted = ((previous >> 18) ^ previous) >> 27;
+        uint32_t rotation = previous >> 59;
+        return (shifted >> rotation) | (shifted << ((-rotation) & 31));
+    }
+
+private:
+    static const uint64_t multiplier = 6364136223846793005ULL;
+    static const uint64_t defaultStream = 0xda3e39cb94b95bdbULL;
+
+    uint64_t state;
+    uint64_t increment;
+};
+
+// The ESP32's true random number generator, fed by RF noise while the radio is on
+class HardwareRandom : public RandomSource
+{
+public:
+    uint32_t next() override
+    {
+        return esp_random();
+    }
+};
@@ -0,0 +1,94 @@
+/*******************************************************************************
+Bounded lock-free single-producer/single-consumer ring buffer.
+
+One context pushes (an ESP-NOW callback in the WiFi task, an ISR...) and one
+context pops (usually loop()). Neither side ever blocks or takes a lock: the
+producer only writes the tail index and the consumer only writes the head
+index. Items pushed while the queue is full are dropped and counted.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Producer side. Returns false, and counts a drop, when the queue is full.
+    bool push(const T &item)
+    {
+        uint32_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == Capacity)
+        {
+            dropCount.store(dropCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        items[tail & mask] = item;
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false when the queue is empty.
+    bool pop(T &item)
+    {
+        uint32_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire))
+            return false;
+
+        item = items[head & mask];
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Hands every queued item to consume() in place, releasing
+    // the slots to the producer in one go once the whole batch is processed.
+    template <typename Consumer>
+    size_t drain(Consumer consume)
+    {
+        uint32_t head = headIndex.load(std::memory_order_relaxed);
+        uint32_t tail = tailIndex.load(std::memory_order_acquire);
+        for (uint32_t i = head; i != tail; ++i)
+        {
+            consume(items[i & mask]);
+        }
+        headIndex.store(tail, std::memory_order_release);
+        return tail - head;
+    }
+
+    size_t size() const
+    {
+        return tailIndex.load(std::memory_order_acquire) - headIndex.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    // Items rejected because the queue was full, since startup
+    uint32_t dropped() const
+    {
+        return dropCount.load(std::memory_order_relaxed);
+    }
+
+    static constexpr size_t capacity()
+    {
+        return Capacity;
+    }
+
+private:
+    static const uint32_t mask = Capacity - 1;
+
+    T items[Capacity];
+    std::atomic<uint32_t> headIndex{0}; // Next slot to read, written by the consumer only
+    std::atomic<uint32_t> tailIndex{0}; // Next slot to write, written by the producer only
+    std::atomic<uint32_t> dropCount{0}; // Written by the producer only
+};
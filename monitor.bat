@@ -1,2 +0,0 @@
-start "COM5 monitor" cmd /C platformio device monitor --baud 115200 --port COM5 --encoding UTF-8
-start "COM7 monitor" cmd /C platformio device monitor --baud 115200 --port COM7 --encoding UTF-8
\ No newline at end of file
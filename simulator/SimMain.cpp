@@ -0,0 +1,984 @@
+/*******************************************************************************
+Native simulation of full games: the manager and up to four remotes run
+their unmodified firmwares in one process, talking over the simulated
+ESP-NOW bus while scripted players press their buttons.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <driver/ledc.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <esp_now.h>
+#include <esp_partition.h>
+#include <esp_random.h>
+#include <BinLog.h>
+#include <BinLogCapture.h>
+#include <BinLogDecoder.h>
+#include <ButtonDebouncer.h>
+#include <ButtonEdges.h>
+#include <CpuBoost.h>
+#include <EspNowLink.h>
+#include <EspNowSim.h>
+#include <EventLoop.h>
+#include <GameHistory.h>
+#include <GuessProtocol.h>
+#include <InputCapture.h>
+#include <InputRecorder.h>
+#include <LatencyStats.h>
+#include <LedAnimator.h>
+#include <LedBreather.h>
+#include <NvsCache.h>
+#include <PeerTable.h>
+#include <PowerManager.h>
+#include <Retransmitter.h>
+#include <SequenceRandom.h>
+#include <SpscQueue.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+// Each firmware gets its own namespace so their globals do not collide, and
+// the remote firmware is built once per simulated remote. Every header they
+// include must already be included above, at global scope.
+namespace manager
+{
+#include "../esp32-guessing-game-manager/src/main.cpp"
+}
+
+namespace remote1
+{
+#include "../esp32-guessing-game-remote/src/main.cpp"
+}
+
+namespace remote2
+{
+#include "../esp32-guessing-game-remote/src/main.cpp"
+}
+
+namespace remote3
+{
+#include "../esp32-guessing-game-remote/src/main.cpp"
+}
+
+namespace remote4
+{
+#include "../esp32-guessing-game-remote/src/main.cpp"
+}
+
+namespace
+{
+    // What the simulation uses of one build of the remote firmware
+    struct RemoteFirmware
+    {
+        const char *name;
+        void (*setup)();
+        void (*loop)();
+        int (*state)();
+        bool (*ready)();
+        bool (*playing)();
+        uint32_t (*playStartedAt)();
+        const uint8_t *buttonPins;
+        void (*flushLog)();
+        decltype(remote1::recorder) *recorder;
+        const LatencyStats *guessLatency;
+#ifdef BENCHMARK_MODE
+        const LatencyStats *roundTrips;
+#endif
+    };
+
+#ifdef BENCHMARK_MODE
+#define REMOTE_ROUND_TRIPS(ns) , &ns::roundTrips
+#else
+#define REMOTE_ROUND_TRIPS(ns)
+#endif
+
+#define REMOTE_FIRMWARE(ns)                                \
+    {                                                      \
+        #ns, ns::setup, ns::loop,                          \
+            [] { return (int)ns::state; },                 \
+            [] { return ns::state == ns::States::ready; },   \
+            [] { return ns::state == ns::States::playing; }, \
+            [] { return ns::playStartedAt; },              \
+            ns::buttonPins,                                \
+            [] { ns::binLog.flush(); },                    \
+            &ns::recorder,                                 \
+            &ns::guessLatency                              \
+        REMOTE_ROUND_TRIPS(ns)                             \
+    }
+
+    const RemoteFirmware remoteFirmwares[] = {
+        REMOTE_FIRMWARE(remote1),
+        REMOTE_FIRMWARE(remote2),
+        REMOTE_FIRMWARE(remote3),
+        REMOTE_FIRMWARE(remote4),
+    };
+    const size_t remoteBuilds = sizeof(remoteFirmwares) / sizeof(remoteFirmwares[0]);
+
+    // MAC addresses of the simulated boards; the firmwares learn each other's by pairing
+    const uint8_t managerMac[ESP_NOW_ETH_ALEN] = {0x30, 0xC9, 0x22, 0xFF, 0x71, 0xAC};
+    const uint8_t remoteMacs[][ESP_NOW_ETH_ALEN] = {
+        {0x30, 0xC9, 0x22, 0xFF, 0x81, 0xD0},
+        {0x02, 0x00, 0x00, 0x00, 0x00, 0x02},
+        {0x02, 0x00, 0x00, 0x00, 0x00, 0x03},
+        {0x02, 0x00, 0x00, 0x00, 0x00, 0x04},
+    };
+    static_assert(sizeof(remoteMacs) / sizeof(remoteMacs[0]) == remoteBuilds, "one MAC address per remote build");
+
+    sim::Node managerNode("manager", managerMac, manager::setup, manager::loop);
+
+    struct Remote
+    {
+        Remote(const RemoteFirmware &firmware, const uint8_t (&mac)[ESP_NOW_ETH_ALEN])
+            : firmware(firmware), node(firmware.name, mac, firmware.setup, firmware.loop) {}
+
+        const RemoteFirmware &firmware;
+        sim::Node node;
+    };
+    std::vector<std::unique_ptr<Remote>> remotes;
+
+    struct Options
+    {
+        uint32_t games = 1;
+        uint32_t remotes = 1;
+        uint8_t difficulty = 0;
+        double wrongRate = 0.0;
+        uint32_t seed = 1;
+        uint32_t timeoutMs = 120000; // Longest the run may go without a game won, a sequence step guessed (or a benchmark guess) before it fails
+        uint32_t pollPeriodMs = 10;  // Reaction time of the player
+        bool verbose = false;
+        const char *capturePrefix = nullptr;
+        const char *nvsPrefix = nullptr;
+        bool exportHistory = false;
+        const char *recordPrefix = nullptr;
+        bool dumpInputs = false;
+        std::string replayNode; // Replays replayPath on this node alone instead of playing
+        const char *replayPath = nullptr;
+#ifdef BENCHMARK_MODE
+        uint32_t guesses = 10000; // Round trips to measure
+#endif
+    };
+
+    // Plays the game like people would: short presses to pick the difficulty,
+    // a long press to start, then on every remote the buttons matching the
+    // sequence the manager picked for it
+    class Player
+    {
+    public:
+        explicit Player(const Options &options) : options(options), rng(options.seed), hands(1 + remotes.size()) {}
+
+        void update(uint32_t now)
+        {
+            if (phase == Phase::playing && manager::state == manager::States::game_over)
+            {
+                gamesPlayed++;
+                lastProgress = now;
+                phase = Phase::waitReady;
+            }
+
+            // Release whatever buttons are held once their press time is over
+            for (Hand &hand : hands)
+            {
+                if (hand.node && now >= hand.releaseAt)
+                {
+                    hand.node->setPin(hand.pin, HIGH);
+                    hand.node = nullptr;
+                    hand.nextActionAt = now + 100;
+                }
+            }
+
+            Hand &managerHand = hands[0];
+            switch (phase)
+            {
+            case Phase::configure:
+                if (!managerHand.free(now))
+                    break;
+                if (manager::difficulty != options.difficulty)
+                    press(managerHand, managerNode, manager::buttonPin, 100, now);
+                else
+                    phase = Phase::waitReady;
+                break;
+
+            case Phase::waitReady:
+                if (managerHand.free(now) && manager::state == manager::States::idle && allRemotesReady())
+                {
+                    press(managerHand, managerNode, manager::buttonPin, manager::longPressDuration + 100, now);
+                    phase = Phase::playing;
+                    startPressedAt = micros();
+                    skewMeasured = false;
+                }
+                break;
+
+            case Phase::playing:
+                measureStartSkew();
+                for (size_t i = 0; i < remotes.size(); ++i)
+                {
+                    guess(*remotes[i], hands[1 + i], now);
+                }
+                break;
+            }
+        }
+
+        // Something the run waits for happened, such as a measured round trip
+        void progressed(uint32_t now)
+        {
+            lastProgress = now;
+        }
+
+        bool timedOut(uint32_t now) const
+        {
+            return now - lastProgress > options.timeoutMs;
+        }
+
+        uint32_t gamesPlayed = 0;
+        uint32_t guesses = 0;
+        uint32_t wrongGuesses = 0;
+        LatencyStats startSkew; // Spread of the instants the remotes entered a game, in us
+
+    private:
+        enum class Phase
+        {
+            configure,
+            waitReady,
+            playing
+        };
+
+        // A button held on a node, and when the player may act on that node again
+        struct Hand
+        {
+            sim::Node *node = nullptr;
+            uint8_t pin = 0;
+            uint32_t releaseAt = 0;
+            uint32_t nextActionAt = 500; // Let the boards boot first
+            uint16_t step = 0;           // Of the remote's sequence, when the player last guessed on it
+
+            bool free(uint32_t now) const
+            {
+                return !node && now >= nextActionAt;
+            }
+        };
+
+        bool allRemotesReady() const
+        {
+            for (const std::unique_ptr<Remote> &remote : remotes)
+            {
+                if (!remote->firmware.ready())
+                    return false;
+            }
+            return true;
+        }
+
+        // Once every remote entered the game, record how far apart they did
+        void measureStartSkew()
+        {
+            if (skewMeasured || remotes.size() < 2)
+                return;
+
+            uint32_t first = UINT32_MAX, last = 0;
+            for (const std::unique_ptr<Remote> &remote : remotes)
+            {
+                uint32_t sincePress = remote->firmware.playStartedAt() - startPressedAt;
+                if ((int32_t)sincePress <= 0)
+                    return;
+                first = std::min(first, sincePress);
+                last = std::max(last, sincePress);
+            }
+            startSkew.record(last - first);
+            skewMeasured = true;
+        }
+
+        void guess(Remote &remote, Hand &hand, uint32_t now)
+        {
+            if (!hand.free(now) || manager::state != manager::States::playing || !remote.firmware.playing())
+                return;
+
+            manager::RemoteState *state = manager::remotes.find(remote.node.mac.data());
+            // Endurance games are long, but never stuck while the remotes move along their sequences
+            if (state->currentStep > hand.step)
+                lastProgress = now;
+            hand.step = state->currentStep;
+            uint8_t value = manager::sequenceStep(*state, state->currentStep);
+            if (std::bernoulli_distribution(options.wrongRate)(rng))
+            {
+                value = value % guessButtons + 1;
+                wrongGuesses++;
+            }
+            press(hand, remote.node, remote.firmware.buttonPins[value - 1], 50, now);
+            guesses++;
+            // Leave the remote time to report the guess before pressing again
+            hand.nextActionAt = now + 500;
+        }
+
+        void press(Hand &hand, sim::Node &node, uint8_t pin, uint32_t duration, uint32_t now)
+        {
+            node.setPin(pin, LOW);
+            hand.node = &node;
+            hand.pin = pin;
+            hand.releaseAt = now + duration;
+        }
+
+        const Options &options;
+        std::mt19937 rng;
+        Phase phase = Phase::configure;
+        std::vector<Hand> hands; // The manager's, then one per remote
+        uint32_t lastProgress = 0;
+        uint32_t startPressedAt = 0;
+        bool skewMeasured = false;
+    };
+
+    // Where a node's serial output goes: printed with the binary log records
+    // decoded, saved to a capture for tools/logmerge, or both
+    struct SerialOutput
+    {
+        bool echo = false;
+        BinLogDecoder decoder;
+        CaptureWriter capture;
+    };
+
+    void routeSerial(sim::Node &node, SerialOutput &output)
+    {
+        output.decoder.onText = [&node](const std::string &line)
+        {
+            printf("[%s] %s\n", node.name, line.c_str());
+        };
+        output.decoder.onRecord = [&node](const LogRecord &record)
+        {
+            if (record.id != LOG_CLOCK_SYNC)
+                printf("[%s] %10.3f ms  %s\n", node.name, record.timestamp / 1000.0, formatLogRecord(record).c_str());
+        };
+        node.serialSink = [&output](const uint8_t *data, size_t len)
+        {
+            output.capture.write(sim::now(), data, len);
+            if (output.echo)
+                output.decoder.feed(data, len);
+        };
+    }
+
+    void usage(const char *program)
+    {
+        printf("Usage: %s [options]\n"
+               "  --games N         Number of games to play (default 1)\n"
+               "  --remotes N       Number of remotes competing, 1-%u (default 1)\n"
+               "  --difficulty D    Difficulty selected before the first game, 0-15 (default 0)\n"
+               "  --wrong-rate P    Probability for the player to press a wrong button (default 0)\n"
+               "  --loss-rate P     Probability for a frame to be lost on its way to one receiver (default 0)\n"
+               "  --latency US      Radio latency per frame in microseconds (default 1000)\n"
+               "  --loop-period US  Shortest virtual time between two loop() calls in microseconds (default 1000)\n"
+               "  --seed N          Seed for the player, the radio and the firmwares' random() (default 1)\n"
+#ifdef BENCHMARK_MODE
+               "  --guesses N       Round trips to measure before stopping (default 10000)\n"
+#endif
+               "  --capture PREFIX  Save each node's serial output to PREFIX-NODE.cap\n"
+               "  --nvs PREFIX      Boot each node with the NVS saved in PREFIX-NODE.nvs and its partitions in\n"
+               "                    PREFIX-NODE-LABEL.bin, and save them there after the run\n"
+               "  --export-history  Ask the manager for its game history over serial once the games are played\n"
+               "  --record PREFIX   Save the inputs each node recorded to PREFIX-NODE.inputs after the run\n"
+               "  --dump-inputs     Ask every node for its recorded inputs over serial once the games are played\n"
+               "  --replay NODE=FILE\n"
+               "                    Instead of playing, boot the manager or remote1 alone and feed it the inputs\n"
+               "                    recorded in FILE; --nvs then only provides its partitions\n"
+               "  --verbose         Echo the nodes' serial output\n",
+               program, (unsigned)remoteBuilds);
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const char *arg = argv[i];
+            const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+            if (!strcmp(arg, "--verbose"))
+            {
+                options.verbose = true;
+                continue;
+            }
+            if (!strcmp(arg, "--export-history"))
+            {
+                options.exportHistory = true;
+                continue;
+            }
+            if (!strcmp(arg, "--dump-inputs"))
+            {
+                options.dumpInputs = true;
+                continue;
+            }
+            if (!value)
+                return false;
+
+            if (!strcmp(arg, "--games"))
+                options.games = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--remotes"))
+                options.remotes = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--difficulty"))
+                options.difficulty = strtoul(value, nullptr, 10) % 16;
+            else if (!strcmp(arg, "--wrong-rate"))
+                options.wrongRate = strtod(value, nullptr);
+            else if (!strcmp(arg, "--loss-rate"))
+                sim::busConfig().lossRate = strtod(value, nullptr);
+            else if (!strcmp(arg, "--latency"))
+                sim::busConfig().latencyUs = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--loop-period"))
+                sim::loopPeriodUs() = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--seed"))
+                options.seed = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--capture"))
+                options.capturePrefix = value;
+            else if (!strcmp(arg, "--nvs"))
+                options.nvsPrefix = value;
+            else if (!strcmp(arg, "--record"))
+                options.recordPrefix = value;
+            else if (!strcmp(arg, "--replay") && strchr(value, '='))
+            {
+                options.replayNode.assign(value, strchr(value, '='));
+                options.replayPath = strchr(value, '=') + 1;
+            }
+#ifdef BENCHMARK_MODE
+            else if (!strcmp(arg, "--guesses"))
+                options.guesses = strtoul(value, nullptr, 10);
+#endif
+            else
+                return false;
+            ++i;
+        }
+        return options.remotes >= 1 && options.remotes <= remoteBuilds;
+    }
+
+    std::string partitionPath(const char *prefix, const sim::Node &node, const std::string &label)
+    {
+        return std::string(prefix) + "-" + node.name + "-" + label + ".bin";
+    }
+
+    // The manager's game history partition, as in esp32-guessing-game-manager/partitions.csv
+    void addPartitions()
+    {
+        managerNode.addPartition("history", ESP_PARTITION_SUBTYPE_DATA_UNDEFINED, 0x290000, 0x10000);
+    }
+
+    bool loadPartitions(const char *prefix, sim::Node &node)
+    {
+        for (const auto &partition : node.partitions)
+        {
+            std::string path = partitionPath(prefix, node, partition.first);
+            if (!sim::loadPartition(node, partition.first.c_str(), path.c_str()))
+            {
+                fprintf(stderr, "Cannot read the partition image %s\n", path.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Close the inputs a node recorded and save them to PREFIX-NODE.inputs
+    template <typename Recorder>
+    void saveRecording(const char *prefix, sim::Node &node, Recorder &recorder)
+    {
+        sim::Context context(node);
+        recorder.finish();
+        std::string path = std::string(prefix) + "-" + node.name + ".inputs";
+        if (!writeInputs(path.c_str(), std::vector<uint8_t>(recorder.data(), recorder.data() + recorder.size())))
+            fprintf(stderr, "Cannot write the inputs %s\n", path.c_str());
+        if (recorder.dropped() > 0)
+            fprintf(stderr, "%s ran out of room for %u inputs, %s ends at the first\n", node.name,
+                    (unsigned)recorder.dropped(), path.c_str());
+    }
+
+    // Name of the simulated board with this MAC address
+    const char *nodeName(const uint8_t *mac)
+    {
+        for (const std::unique_ptr<Remote> &remote : remotes)
+        {
+            if (memcmp(remote->node.mac.data(), mac, ESP_NOW_ETH_ALEN) == 0)
+                return remote->node.name;
+        }
+        return "a remote left out of this run";
+    }
+
+    void printStates(FILE *out)
+    {
+        fprintf(out, "manager state %d", (int)manager::state);
+        for (const std::unique_ptr<Remote> &remote : remotes)
+        {
+            fprintf(out, ", %s state %d", remote->node.name, remote->firmware.state());
+        }
+    }
+
+#ifdef BENCHMARK_MODE
+    uint32_t roundTripCount()
+    {
+        uint32_t count = 0;
+        for (const std::unique_ptr<Remote> &remote : remotes)
+        {
+            count += remote->firmware.roundTrips->count();
+        }
+        return count;
+    }
+#endif
+
+    // Boot one firmware alone and feed it the inputs of a recording at the times they came.
+    // The other nodes are not simulated: what they sent is among the inputs, and what the
+    // replayed node sends only goes into its output digest.
+    int replay(const Options &options)
+    {
+        std::vector<uint8_t> recording;
+        std::vector<InputEvent> inputs;
+        if (!readInputs(options.replayPath, recording))
+        {
+            fprintf(stderr, "Cannot read the inputs %s\n", options.replayPath);
+            return EXIT_FAILURE;
+        }
+        if (!decodeInputs(recording, inputs))
+            fprintf(stderr, "%s ends in the middle of an input, replaying those before it\n", options.replayPath);
+
+        sim::Node *node = &managerNode;
+        if (options.replayNode == remoteFirmwares[0].name)
+        {
+            remotes.emplace_back(new Remote(remoteFirmwares[0], remoteMacs[0]));
+            node = &remotes[0]->node;
+        }
+        else if (options.replayNode != managerNode.name)
+        {
+            fprintf(stderr, "Only the manager and %s can be replayed\n", remoteFirmwares[0].name);
+            return EXIT_FAILURE;
+        }
+        node->replaying = true;
+
+        SerialOutput output;
+        output.echo = options.verbose;
+        if (options.capturePrefix)
+        {
+            std::string path = std::string(options.capturePrefix) + "-" + node->name + ".cap";
+            if (!output.capture.open(path.c_str()))
+            {
+                fprintf(stderr, "Cannot write the capture %s\n", path.c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        if (options.verbose || options.capturePrefix)
+            routeSerial(*node, output);
+
+        // Flash partitions are not part of the recording: the node gets the images it booted with, if saved
+        addPartitions();
+        if (options.nvsPrefix && !loadPartitions(options.nvsPrefix, *node))
+            return EXIT_FAILURE;
+
+        // The recording goes on until its last end, or as far as it goes when it was cut short
+        uint64_t end = inputs.empty() ? 0 : inputs.back().time;
+        for (const InputEvent &input : inputs)
+        {
+            if (input.kind == INPUT_END)
+                end = input.time;
+        }
+
+        // The state the node booted with is set right away, the rest is delivered at its time
+        std::vector<InputEvent> edges;
+        bool booted = false;
+        size_t replayed = 0;
+        for (const InputEvent &input : inputs)
+        {
+            const std::vector<uint8_t> &payload = input.payload;
+            if (input.time > end)
+                break;
+            replayed++;
+
+            switch (input.kind)
+            {
+            case INPUT_ENTROPY:
+            {
+                uint32_t value = 0;
+                memcpy(&value, payload.data(), std::min(payload.size(), sizeof(value)));
+                node->entropy.push_back(value);
+#ifdef SEQUENCE_SEED
+                // Seeded builds take the manager's seed from the build rather than the RNG
+                if (node == &managerNode)
+                    manager::sequenceSeed = value;
+#endif
+                break;
+            }
+            case INPUT_NVS:
+            {
+                std::string name((const char *)payload.data(), strnlen((const char *)payload.data(), payload.size()));
+                size_t keyStart = std::min(name.size() + 1, payload.size());
+                std::string key((const char *)payload.data() + keyStart, strnlen((const char *)payload.data() + keyStart, payload.size() - keyStart));
+                size_t dataStart = std::min(keyStart + key.size() + 1, payload.size());
+                node->nvs[name][key].assign(payload.begin() + dataStart, payload.end());
+                break;
+            }
+            case INPUT_PIN:
+            {
+                uint8_t pin = input.source;
+                uint8_t level = payload.empty() ? LOW : payload[0];
+                if (pin >= sim::pinCount)
+                    break;
+                if (!booted)
+                {
+                    node->pinLevels[pin] = level;
+                    break;
+                }
+                edges.push_back(input);
+                break;
+            }
+            case INPUT_FRAME:
+                if (payload.size() > ESP_NOW_ETH_ALEN)
+                {
+                    sim::MacAddress mac;
+                    std::copy(payload.begin(), payload.begin() + ESP_NOW_ETH_ALEN, mac.begin());
+                    sim::post(*node, {input.time, true, mac, std::vector<uint8_t>(payload.begin() + ESP_NOW_ETH_ALEN, payload.end()), ESP_NOW_SEND_SUCCESS});
+                }
+                break;
+            case INPUT_SEND_STATUS:
+                if (payload.size() == ESP_NOW_ETH_ALEN)
+                {
+                    sim::MacAddress mac;
+                    std::copy(payload.begin(), payload.end(), mac.begin());
+                    sim::post(*node, {input.time, false, mac, {}, (esp_now_send_status_t)input.source});
+                }
+                break;
+            case INPUT_SERIAL:
+            {
+                std::string bytes(payload.begin(), payload.end());
+                sim::schedule(*node, input.time, [node, bytes]
+                              { node->receiveSerial(bytes); });
+                break;
+            }
+            case INPUT_READY:
+                booted = true;
+                break;
+            default:
+                break;
+            }
+        }
+
+        node->start();
+        // Like the player's hands, the edges come from a task spawned after the node's, so that
+        // they are seen after the node's timers due at the same instant, as they were
+        sim::spawn("replay edges", nullptr, [node, edges]
+                   {
+                       for (const InputEvent &edge : edges)
+                       {
+                           uint8_t pin = edge.source;
+                           uint8_t level = edge.payload.empty() ? LOW : edge.payload[0];
+                           sim::sleepUntil(edge.time);
+                           // An interrupt on one edge only records that edge: the pin goes back to the
+                           // other level first, which such an interrupt ignores
+                           if (node->pinLevels[pin] == level)
+                               node->setPin(pin, !level);
+                           node->setPin(pin, level);
+                       }
+                   });
+        sim::spawn("replay", nullptr, [end]
+                   {
+                       sim::sleepUntil(end);
+                       sim::stop();
+                   });
+
+        auto wallStart = std::chrono::steady_clock::now();
+        bool stopped = sim::run();
+        double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        double simSeconds = sim::now() / 1e6;
+        if (!stopped)
+        {
+            fprintf(stderr, "Every task blocked at %.3f s, before the end of the recording\n", simSeconds);
+            return EXIT_FAILURE;
+        }
+
+        if (options.verbose || options.capturePrefix)
+        {
+            sim::Context context(*node);
+            if (node == &managerNode)
+                manager::binLog.flush();
+            else
+                remotes[0]->firmware.flushLog();
+        }
+
+        printf("Replayed %zu inputs on %s in %.3f s of simulated time, %.3f s of wall time (%.0fx real time)\n",
+               replayed, node->name, simSeconds, wallSeconds, simSeconds / wallSeconds);
+        printf("Radio output: %s %llu frames (digest %016llx)\n", node->name, (unsigned long long)node->framesSent,
+               (unsigned long long)node->outputDigest);
+        printf("Loop passes: %s %llu\n", node->name, (unsigned long long)node->loopPasses);
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.replayPath)
+        return replay(options);
+
+    sim::seed(options.seed);
+    randomSeed(options.seed);
+#ifdef SEQUENCE_SEED
+    // Seeded builds draw the sequences from their own generator, which --seed restarts too
+    manager::sequenceSeed = options.seed;
+#endif
+
+    for (size_t i = 0; i < options.remotes; ++i)
+    {
+        remotes.emplace_back(new Remote(remoteFirmwares[i], remoteMacs[i]));
+    }
+
+    std::vector<sim::Node *> nodes = {&managerNode};
+    for (const std::unique_ptr<Remote> &remote : remotes)
+    {
+        nodes.push_back(&remote->node);
+    }
+
+    std::vector<SerialOutput> outputs(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        outputs[i].echo = options.verbose;
+        if (options.capturePrefix)
+        {
+            std::string path = std::string(options.capturePrefix) + "-" + nodes[i]->name + ".cap";
+            if (!outputs[i].capture.open(path.c_str()))
+            {
+                fprintf(stderr, "Cannot write the capture %s\n", path.c_str());
+                return EXIT_FAILURE;
+            }
+        }
+        if (options.verbose || options.capturePrefix)
+            routeSerial(*nodes[i], outputs[i]);
+    }
+
+    addPartitions();
+
+    // Remotes the manager paired in an earlier run but this one leaves out never answer it
+    if (options.nvsPrefix)
+    {
+        for (sim::Node *node : nodes)
+        {
+            std::string path = std::string(options.nvsPrefix) + "-" + node->name + ".nvs";
+            if (!sim::loadNvs(*node, path.c_str()))
+            {
+                fprintf(stderr, "Cannot read the NVS %s\n", path.c_str());
+                return EXIT_FAILURE;
+            }
+            if (!loadPartitions(options.nvsPrefix, *node))
+                return EXIT_FAILURE;
+        }
+    }
+
+    for (sim::Node *node : nodes)
+    {
+        sim::attach(*node);
+    }
+    for (sim::Node *node : nodes)
+    {
+        node->start();
+    }
+
+    Player player(options);
+    bool timedOut = false;
+#ifndef BENCHMARK_MODE
+    // Once the games are played, the history and the inputs are requested and the run goes on until they are out
+    bool requested = false;
+    auto exporting = [&]
+    {
+        if (!requested)
+        {
+            if (options.exportHistory)
+                managerNode.receiveSerial(std::string(1, manager::exportHistoryCommand));
+            if (options.dumpInputs)
+            {
+                managerNode.receiveSerial(std::string(1, manager::dumpInputsCommand));
+                for (const std::unique_ptr<Remote> &remote : remotes)
+                {
+                    remote->node.receiveSerial(std::string(1, remote1::dumpInputsCommand));
+                }
+            }
+            requested = true;
+        }
+
+        bool busy = !managerNode.serialInput.empty() || manager::exportingHistory || manager::recorder.dumpInProgress();
+        for (const std::unique_ptr<Remote> &remote : remotes)
+        {
+            busy = busy || !remote->node.serialInput.empty() || remote->firmware.recorder->dumpInProgress();
+        }
+        return busy;
+    };
+#endif
+    sim::spawn("player", nullptr, [&]
+               {
+                   for (;;)
+                   {
+                       uint32_t now = millis();
+                       player.update(now);
+#ifdef BENCHMARK_MODE
+                       // The remotes guess on their own; the player only starts the games
+                       static uint32_t roundTrips = 0;
+                       if (roundTripCount() != roundTrips)
+                       {
+                           roundTrips = roundTripCount();
+                           player.progressed(now);
+                       }
+                       if (roundTrips >= options.guesses)
+                           sim::stop();
+#else
+                       if (player.gamesPlayed >= options.games && !exporting())
+                           sim::stop();
+#endif
+                       if (player.timedOut(now))
+                       {
+                           timedOut = true;
+                           sim::stop();
+                       }
+                       delay(options.pollPeriodMs);
+                   } });
+
+    auto wallStart = std::chrono::steady_clock::now();
+    bool stopped = sim::run();
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    double simSeconds = sim::now() / 1e6;
+
+    if (!stopped || timedOut)
+    {
+        fprintf(stderr, "Game %u did not finish %s at %.3f s (", player.gamesPlayed + 1,
+                stopped ? "in time" : "because every task blocked", simSeconds);
+        printStates(stderr);
+        fprintf(stderr, ")\n");
+        return EXIT_FAILURE;
+    }
+
+    // Write out what the nodes logged since their flush tasks last ran
+    if (options.verbose || options.capturePrefix)
+    {
+        {
+            sim::Context context(managerNode);
+            manager::binLog.flush();
+        }
+        for (const std::unique_ptr<Remote> &remote : remotes)
+        {
+            sim::Context context(remote->node);
+            remote->firmware.flushLog();
+        }
+    }
+
+    if (options.recordPrefix)
+    {
+        saveRecording(options.recordPrefix, managerNode, manager::recorder);
+        for (const std::unique_ptr<Remote> &remote : remotes)
+        {
+            saveRecording(options.recordPrefix, remote->node, *remote->firmware.recorder);
+        }
+    }
+
+    if (options.nvsPrefix)
+    {
+        for (sim::Node *node : nodes)
+        {
+            std::string path = std::string(options.nvsPrefix) + "-" + node->name + ".nvs";
+            if (!sim::saveNvs(*node, path.c_str()))
+                fprintf(stderr, "Cannot write the NVS %s\n", path.c_str());
+            for (const auto &partition : node->partitions)
+            {
+                path = partitionPath(options.nvsPrefix, *node, partition.first);
+                if (!sim::savePartition(*node, partition.first.c_str(), path.c_str()))
+                    fprintf(stderr, "Cannot write the partition image %s\n", path.c_str());
+            }
+        }
+    }
+
+    const sim::BusStats &stats = sim::busStats();
+    printf("Games played: %u in %.3f s of simulated time, %.3f s of wall time (%.1f games/s, %.0fx real time)\n",
+           player.gamesPlayed, simSeconds, wallSeconds, player.gamesPlayed / wallSeconds, simSeconds / wallSeconds);
+    printf("Guesses: %u (%u wrong)\n", player.guesses, player.wrongGuesses);
+    if (remotes.size() > 1)
+    {
+        printf("Games won:");
+        for (const std::unique_ptr<Remote> &remote : remotes)
+        {
+            printf(" %s %u", remote->node.name, manager::remotes.find(remote->node.mac.data())->score);
+        }
+        printf("\n");
+        printf("Start skew over %u games: p50 %u us, p99 %u us, max %u us\n", player.startSkew.count(),
+               player.startSkew.percentile(0.50), player.startSkew.percentile(0.99), player.startSkew.max());
+    }
+    printf("Frames: %llu sent, %llu delivered, %llu lost, %llu undeliverable, %llu missed by sleeping radios\n",
+           (unsigned long long)stats.sent, (unsigned long long)stats.delivered,
+           (unsigned long long)stats.lost, (unsigned long long)stats.undeliverable,
+           (unsigned long long)stats.missedAsleep);
+    for (const std::unique_ptr<Remote> &remote : remotes)
+    {
+        const LatencyStats &guessLatency = *remote->firmware.guessLatency;
+        if (guessLatency.count() > 0)
+            printf("Press to guess on air over %u guesses on %s: p50 %u us, p95 %u us, p99 %u us (max %u)\n",
+                   guessLatency.count(), remote->node.name, guessLatency.percentile(0.50),
+                   guessLatency.percentile(0.95), guessLatency.percentile(0.99), guessLatency.max());
+    }
+
+    uint64_t loopPasses = 0;
+    printf("Serial output:");
+    for (sim::Node *node : nodes)
+    {
+        printf(" %s %llu bytes", node->name, (unsigned long long)node->serialBytes);
+        loopPasses += node->loopPasses;
+    }
+    printf("\nLoop passes:");
+    for (sim::Node *node : nodes)
+    {
+        printf(" %s %llu", node->name, (unsigned long long)node->loopPasses);
+    }
+    printf(" (%.1f/s of simulated time)\n", loopPasses / simSeconds);
+    printf("Radio output:");
+    for (sim::Node *node : nodes)
+    {
+        printf(" %s %llu frames (digest %016llx)", node->name, (unsigned long long)node->framesSent,
+               (unsigned long long)node->outputDigest);
+    }
+    printf("\nInputs recorded: manager %u bytes (%u dropped)", (unsigned)manager::recorder.size(),
+           (unsigned)manager::recorder.dropped());
+    for (const std::unique_ptr<Remote> &remote : remotes)
+    {
+        printf(", %s %u bytes (%u dropped)", remote->node.name, (unsigned)remote->firmware.recorder->size(),
+               (unsigned)remote->firmware.recorder->dropped());
+    }
+    printf("\n");
+    printf("NVS writes:");
+    for (sim::Node *node : nodes)
+    {
+        printf(" %s %llu", node->name, (unsigned long long)node->nvsWrites);
+    }
+    printf("\n");
+    if (manager::cpu.scaling())
+        printf("Manager CPU: %.3f s at %d MHz, %.3f s scaled down, %u switches\n", manager::cpu.timeBoostedUs() / 1e6,
+               manager::boostFrequency, manager::cpu.timeScaledUs() / 1e6, manager::cpu.switches());
+    else
+        printf("Manager CPU: frequency scaling not applied\n");
+    printf("History: %u games stored, %llu flash sectors erased", manager::history.size(),
+           (unsigned long long)managerNode.flashErases);
+    if (manager::history.highScores() > 0)
+    {
+        const GameRecord &best = manager::history.highScore(0);
+        printf("; high score: game %u, difficulty %u, %u guesses (%u wrong) in %.3f s by %s", best.game,
+               best.difficulty, best.guesses, best.wrongGuesses, best.durationMs / 1000.0, nodeName(best.mac));
+    }
+    printf("\n");
+    if (options.exportHistory)
+        printf("History exported: %u games\n", manager::exportedGames);
+#ifdef BENCHMARK_MODE
+    for (const std::unique_ptr<Remote> &remote : remotes)
+    {
+        const LatencyStats &roundTrips = *remote->firmware.roundTrips;
+        printf("Round trip over %u guesses on %s: p50 %u us, p95 %u us, p99 %u us (min %u, mean %u, max %u)\n",
+               roundTrips.count(), remote->node.name, roundTrips.percentile(0.50), roundTrips.percentile(0.95),
+               roundTrips.percentile(0.99), roundTrips.min(), roundTrips.mean(), roundTrips.max());
+    }
+#endif
+    return EXIT_SUCCESS;
+}
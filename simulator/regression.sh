@@ -0,0 +1,30 @@
+#!/bin/sh
+# Play games under loss with several remotes and wrong guesses, over a range of seeds,
+# and fail if any run stalls. Usage: simulator/regression.sh PROGRAM [SEEDS]
+# PROGRAM is the native build, e.g. .pio/build/native/program.
+
+program=${1:?usage: $0 PROGRAM [SEEDS]}
+seeds=${2:-30}
+failed=0
+
+run()
+{
+    seed=1
+    while [ "$seed" -le "$seeds" ]; do
+        if ! "$program" "$@" --seed "$seed" >/dev/null 2>&1; then
+            echo "FAILED: $program $* --seed $seed"
+            failed=$((failed + 1))
+        fi
+        seed=$((seed + 1))
+    done
+}
+
+run --games 20 --difficulty 3 --wrong-rate 0.2
+run --games 20 --remotes 2 --difficulty 3 --wrong-rate 0.2 --loss-rate 0.02
+run --games 10 --remotes 4 --difficulty 5 --wrong-rate 0.2 --loss-rate 0.1
+
+if [ "$failed" -gt 0 ]; then
+    echo "$failed runs failed"
+    exit 1
+fi
+echo "All runs passed"
@@ -0,0 +1,161 @@
+/*******************************************************************************
+Decoded serial log of one node, and the alignment of its clock on the host's.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#include "NodeLog.h"
+
+#include <algorithm>
+#include <map>
+
+NodeLog::NodeLog(const std::string &name) : name(name)
+{
+    decoder.onText = [this](const std::string &line)
+    {
+        LogEntry entry{chunkTime, false, {}, line};
+        add(entry);
+    };
+    decoder.onRecord = [this](const LogRecord &record)
+    {
+        // The 32-bit timestamp wraps every 71 minutes; a jump back by more than half of that is a restart
+        uint32_t elapsed = record.timestamp - lastStamp;
+        if (!stamped)
+        {
+            deviceTime = record.timestamp;
+        }
+        else if (elapsed < 0x80000000u)
+        {
+            deviceTime += elapsed;
+        }
+        else
+        {
+            deviceTime = record.timestamp;
+            segment++;
+        }
+        stamped = true;
+        lastStamp = record.timestamp;
+
+        LogEntry entry{chunkTime, true, record, {}};
+        entry.deviceTime = deviceTime;
+        entry.segment = segment;
+        add(entry);
+    };
+}
+
+size_t NodeLog::feed(uint64_t hostTime, const uint8_t *data, size_t len)
+{
+    size_t before = entries.size();
+    chunkTime = hostTime;
+    decoder.feed(data, len);
+    return entries.size() - before;
+}
+
+void NodeLog::add(LogEntry entry)
+{
+    entry.time = entry.hostTime;
+    entries.push_back(std::move(entry));
+}
+
+void NodeLog::align()
+{
+    std::vector<std::vector<Point>> points(segment + 1);
+    for (const LogEntry &entry : entries)
+    {
+        if (entry.isRecord)
+            points[entry.segment].push_back({(double)entry.deviceTime, (double)entry.hostTime - (double)entry.deviceTime});
+    }
+
+    hulls.clear();
+    for (std::vector<Point> &segmentPoints : points)
+    {
+        hulls.push_back(lowerHull(windowMinima(std::move(segmentPoints))));
+    }
+
+    // Text lines carry no device time and stay at their arrival time
+    for (LogEntry &entry : entries)
+    {
+        if (entry.isRecord && !hulls[entry.segment].empty())
+            entry.time = entry.deviceTime + (int64_t)evaluate(hulls[entry.segment], entry.deviceTime);
+    }
+}
+
+int64_t NodeLog::initialOffset() const
+{
+    if (hulls.empty() || hulls[0].empty())
+        return 0;
+    return hulls[0].front().y;
+}
+
+double NodeLog::driftPpm() const
+{
+    if (hulls.empty() || hulls[0].size() < 2)
+        return 0;
+    const Point &first = hulls[0].front();
+    const Point &last = hulls[0].back();
+    return (last.y - first.y) / (last.x - first.x) * 1e6;
+}
+
+// The lowest point of each alignment window. The hull always goes through the first and last
+// points; taken alone, a record that was slow to arrive would tilt it.
+std::vector<NodeLog::Point> NodeLog::windowMinima(std::vector<Point> points)
+{
+    std::vector<Point> minima;
+    if (points.empty())
+        return minima;
+
+    double origin = std::min_element(points.begin(), points.end(), [](const Point &a, const Point &b)
+                                     { return a.x < b.x; })->x;
+    std::map<uint64_t, Point> windows;
+    for (const Point &point : points)
+    {
+        uint64_t window = (point.x - origin) / alignmentWindowUs;
+        auto found = windows.find(window);
+        if (found == windows.end() || point.y < found->second.y)
+            windows[window] = point;
+    }
+    for (const auto &window : windows)
+    {
+        minima.push_back(window.second);
+    }
+    return minima;
+}
+
+std::vector<NodeLog::Point> NodeLog::lowerHull(std::vector<Point> points)
+{
+    std::sort(points.begin(), points.end(), [](const Point &a, const Point &b)
+              { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+
+    std::vector<Point> hull;
+    for (const Point &point : points)
+    {
+        // Keep the lowest point for each device time
+        if (!hull.empty() && hull.back().x == point.x)
+            continue;
+        while (hull.size() >= 2)
+        {
+            const Point &o = hull[hull.size() - 2];
+            const Point &a = hull.back();
+            if ((a.x - o.x) * (point.y - o.y) - (a.y - o.y) * (point.x - o.x) > 0)
+                break;
+            hull.pop_back();
+        }
+        hull.push_back(point);
+    }
+    return hull;
+}
+
+// Offset at device time x: linear between hull points, constant past the ends
+double NodeLog::evaluate(const std::vector<Point> &hull, double x)
+{
+    if (x <= hull.front().x)
+        return hull.front().y;
+    if (x >= hull.back().x)
+        return hull.back().y;
+
+    auto next = std::upper_bound(hull.begin(), hull.end(), x, [](double value, const Point &point)
+                                 { return value < point.x; });
+    const Point &b = *next;
+    const Point &a = *(next - 1);
+    return a.y + (b.y - a.y) * (x - a.x) / (b.x - a.x);
+}
@@ -0,0 +1,80 @@
+/*******************************************************************************
+Decoded serial log of one node, and the alignment of its clock on the host's.
+
+Each record carries the node's esp_timer time and arrives at the host some
+time later: transmission, the flush period of BinLog and OS buffering only
+ever add delay. The lower envelope of (host arrival - device time) over the
+records is therefore the best estimate of the clock offset. It is taken over
+windows of 10 s, each holding several of BinLog's clock syncs, and the convex
+hull of the windows' minima follows the drift between the two crystals.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <BinLogDecoder.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct LogEntry
+{
+    uint64_t hostTime; // Arrival of the chunk holding the entry, in host microseconds
+    bool isRecord;     // Binary record, otherwise a text line
+    LogRecord record;
+    std::string text;
+    uint64_t deviceTime = 0; // Record timestamp, unwrapped to 64 bits
+    uint32_t segment = 0;    // Increments when the device clock restarts, e.g. on a reboot
+    int64_t time = 0;        // On the host clock, set by align()
+};
+
+class NodeLog
+{
+public:
+    explicit NodeLog(const std::string &name);
+    NodeLog(const NodeLog &) = delete;
+    NodeLog &operator=(const NodeLog &) = delete;
+
+    // Decode a chunk of serial bytes that arrived at hostTime. Returns the number of new entries.
+    size_t feed(uint64_t hostTime, const uint8_t *data, size_t len);
+
+    // Place every entry on the host clock
+    void align();
+
+    // Clock offset (host - device) at the start of the first segment, and its drift in ppm
+    int64_t initialOffset() const;
+    double driftPpm() const;
+
+    // Frames dropped for a bad CRC, usually bytes lost at full baud
+    uint32_t badFrames() const
+    {
+        return decoder.badFrames;
+    }
+
+    const std::string name;
+    std::vector<LogEntry> entries;
+
+private:
+    struct Point
+    {
+        double x;
+        double y;
+    };
+
+    static const uint32_t alignmentWindowUs = 10000000;
+
+    void add(LogEntry entry);
+    static std::vector<Point> windowMinima(std::vector<Point> points);
+    static std::vector<Point> lowerHull(std::vector<Point> points);
+    static double evaluate(const std::vector<Point> &hull, double x);
+
+    BinLogDecoder decoder;
+    uint64_t chunkTime = 0;
+    bool stamped = false;
+    uint32_t lastStamp = 0;
+    uint64_t deviceTime = 0;
+    uint32_t segment = 0;
+    std::vector<std::vector<Point>> hulls; // One per segment
+};
@@ -0,0 +1,250 @@
+/*******************************************************************************
+Merged timeline and statistics of the logs of several nodes.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#include "Report.h"
+
+#include <LatencyStats.h>
+#include <LogEvents.h>
+
+#include <algorithm>
+#include <climits>
+#include <map>
+
+namespace
+{
+    // An event on one node and an event it causes on another
+    struct LatencyPair
+    {
+        uint16_t cause;
+        uint16_t effect;
+        const char *name;
+    };
+
+    const LatencyPair latencyPairs[] = {
+        {LOG_GAME_START_SENT, LOG_GAME_STARTED, "game start"},
+        {LOG_GUESS_SENT, LOG_GUESS_RECEIVED, "guess"},
+        {LOG_GUESS_RECEIVED, LOG_RIGHT_GUESS, "right guess verdict"},
+        {LOG_GUESS_RECEIVED, LOG_WRONG_GUESS, "wrong guess verdict"},
+        {LOG_GUESS_RECEIVED, LOG_GAME_WON, "game won verdict"},
+    };
+
+    struct TimelineEntry
+    {
+        const NodeLog *node;
+        const LogEntry *entry;
+    };
+
+    // A game of an exported history, unpacked from its LOG_HISTORY_RECORD
+    struct HistoryGame
+    {
+        uint32_t game;
+        uint32_t durationMs;
+        uint8_t difficulty;
+        uint8_t wrongGuesses;
+        uint16_t guesses;
+        uint16_t remote;
+    };
+
+    // Harder, then with fewer mistakes, then faster, then older, like betterGame() in GameHistory.h
+    bool betterGame(const HistoryGame &a, const HistoryGame &b)
+    {
+        if (a.difficulty != b.difficulty)
+            return a.difficulty > b.difficulty;
+        if (a.wrongGuesses != b.wrongGuesses)
+            return a.wrongGuesses < b.wrongGuesses;
+        if (a.durationMs != b.durationMs)
+            return a.durationMs < b.durationMs;
+        return a.game < b.game;
+    }
+
+    std::vector<TimelineEntry> merge(const NodeLogs &nodes)
+    {
+        std::vector<TimelineEntry> timeline;
+        for (const std::unique_ptr<NodeLog> &node : nodes)
+        {
+            for (const LogEntry &entry : node->entries)
+            {
+                timeline.push_back({node.get(), &entry});
+            }
+        }
+        std::stable_sort(timeline.begin(), timeline.end(), [](const TimelineEntry &a, const TimelineEntry &b)
+                         { return a.entry->time < b.entry->time; });
+        return timeline;
+    }
+}
+
+void printEntry(FILE *out, const NodeLog &node, const LogEntry &entry, int64_t origin)
+{
+    if (entry.isRecord && entry.record.id == LOG_CLOCK_SYNC)
+        return;
+
+    double time = (entry.time - origin) / 1000.0;
+    if (entry.isRecord)
+        fprintf(out, " %12.3f  %-8s  %s\n", time, node.name.c_str(), formatLogRecord(entry.record).c_str());
+    else
+        fprintf(out, "~%12.3f  %-8s  %s\n", time, node.name.c_str(), entry.text.c_str());
+}
+
+void printTimeline(FILE *out, const NodeLogs &nodes)
+{
+    std::vector<TimelineEntry> timeline = merge(nodes);
+    if (timeline.empty())
+        return;
+
+    int64_t origin = timeline.front().entry->time;
+    for (const TimelineEntry &item : timeline)
+    {
+        printEntry(out, *item.node, *item.entry, origin);
+    }
+}
+
+void printHistory(FILE *out, const NodeLogs &nodes, size_t count)
+{
+    for (const std::unique_ptr<NodeLog> &node : nodes)
+    {
+        // Games exported more than once are counted once
+        std::map<uint32_t, HistoryGame> games;
+        for (const LogEntry &entry : node->entries)
+        {
+            if (!entry.isRecord || entry.record.id != LOG_HISTORY_RECORD || entry.record.argCount < 4)
+                continue;
+            const int32_t *args = entry.record.args;
+            uint32_t stats = args[2];
+            games[args[0]] = {(uint32_t)args[0], (uint32_t)args[1], (uint8_t)stats, (uint8_t)(stats >> 8),
+                              (uint16_t)(stats >> 16), (uint16_t)args[3]};
+        }
+        if (games.empty())
+            continue;
+
+        std::vector<HistoryGame> ranking;
+        for (const auto &game : games)
+        {
+            ranking.push_back(game.second);
+        }
+        std::sort(ranking.begin(), ranking.end(), betterGame);
+
+        fprintf(out, "History of %s: %zu games, games %u to %u\n", node->name.c_str(), ranking.size(),
+                games.begin()->first, games.rbegin()->first);
+        fprintf(out, "  %4s  %6s  %10s  %7s  %5s  %10s  %6s\n", "rank", "game", "difficulty", "guesses", "wrong", "time (s)", "remote");
+        for (size_t i = 0; i < ranking.size() && i < count; ++i)
+        {
+            const HistoryGame &game = ranking[i];
+            fprintf(out, "  %4zu  %6u  %10u  %7u  %5u  %10.3f  %04x\n", i + 1, game.game, game.difficulty,
+                    game.guesses, game.wrongGuesses, game.durationMs / 1000.0, game.remote);
+        }
+    }
+}
+
+void printStatistics(FILE *out, const NodeLogs &nodes, uint32_t windowUs)
+{
+    fprintf(out, "Clocks:\n");
+    for (const std::unique_ptr<NodeLog> &node : nodes)
+    {
+        size_t records = std::count_if(node->entries.begin(), node->entries.end(), [](const LogEntry &entry)
+                                       { return entry.isRecord; });
+        fprintf(out, "  %-8s  offset %+.3f ms, drift %+.1f ppm, %zu records, %zu text lines, %u bad frames\n",
+                node->name.c_str(), node->initialOffset() / 1000.0, node->driftPpm(),
+                records, node->entries.size() - records, node->badFrames());
+    }
+
+    fprintf(out, "Events:\n  %-20s", "");
+    for (const std::unique_ptr<NodeLog> &node : nodes)
+    {
+        fprintf(out, "  %8s", node->name.c_str());
+    }
+    fprintf(out, "\n");
+    for (const LogEventInfo &info : logEvents)
+    {
+        std::vector<size_t> counts;
+        for (const std::unique_ptr<NodeLog> &node : nodes)
+        {
+            counts.push_back(std::count_if(node->entries.begin(), node->entries.end(), [&info](const LogEntry &entry)
+                                           { return entry.isRecord && entry.record.id == info.id; }));
+        }
+        if (std::all_of(counts.begin(), counts.end(), [](size_t count)
+                        { return count == 0; }))
+            continue;
+
+        fprintf(out, "  %-20s", info.name);
+        for (size_t count : counts)
+        {
+            fprintf(out, "  %8zu", count);
+        }
+        fprintf(out, "\n");
+    }
+
+    // Match every effect with the latest cause logged on another node
+    std::vector<TimelineEntry> timeline = merge(nodes);
+    fprintf(out, "Latencies (us):\n");
+    for (const LatencyPair &pair : latencyPairs)
+    {
+        LatencyStats latencies;
+        const TimelineEntry *cause = nullptr;
+        uint32_t early = 0;
+        for (const TimelineEntry &item : timeline)
+        {
+            if (!item.entry->isRecord)
+                continue;
+            if (item.entry->record.id == pair.cause)
+            {
+                cause = &item;
+            }
+            else if (item.entry->record.id == pair.effect && cause && cause->node != item.node)
+            {
+                int64_t latency = item.entry->time - cause->entry->time;
+                if (latency <= windowUs)
+                {
+                    // Clock alignment is only as good as the fastest records; it can put an effect first
+                    if (latency < 0)
+                        early++;
+                    latencies.record(std::max<int64_t>(latency, 0));
+                }
+                cause = nullptr;
+            }
+        }
+        if (latencies.count() == 0)
+            continue;
+
+        fprintf(out, "  %-20s  %6u samples  p50 %7u  p95 %7u  p99 %7u  min %7u  max %7u",
+                pair.name, latencies.count(), latencies.percentile(0.50), latencies.percentile(0.95),
+                latencies.percentile(0.99), latencies.min(), latencies.max());
+        if (early > 0)
+            fprintf(out, "  (%u before their cause)", early);
+        fprintf(out, "\n");
+    }
+
+    // The remotes are told when to begin, so they should enter a game together
+    LatencyStats skews;
+    std::vector<const TimelineEntry *> started;
+    auto recordSkew = [&skews, &started]()
+    {
+        if (started.size() > 1)
+            skews.record(started.back()->entry->time - started.front()->entry->time);
+        started.clear();
+    };
+    for (const TimelineEntry &item : timeline)
+    {
+        if (!item.entry->isRecord)
+            continue;
+        if (item.entry->record.id == LOG_GAME_START_SENT)
+        {
+            recordSkew();
+        }
+        else if (item.entry->record.id == LOG_GAME_STARTED &&
+                 std::none_of(started.begin(), started.end(), [&item](const TimelineEntry *other)
+                              { return other->node == item.node; }))
+        {
+            started.push_back(&item);
+        }
+    }
+    recordSkew();
+    if (skews.count() > 0)
+    {
+        fprintf(out, "  %-20s  %6u samples  p50 %7u  p95 %7u  p99 %7u  min %7u  max %7u\n",
+                "start skew", skews.count(), skews.percentile(0.50), skews.percentile(0.95),
+                skews.percentile(0.99), skews.min(), skews.max());
+    }
+}
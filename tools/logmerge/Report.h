@@ -0,0 +1,29 @@
+/*******************************************************************************
+Merged timeline and statistics of the logs of several nodes.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include "NodeLog.h"
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+typedef std::vector<std::unique_ptr<NodeLog>> NodeLogs;
+
+// Print one entry, except for clock syncs. Times are in milliseconds since origin; text lines are
+// marked, as their time is when they arrived.
+void printEntry(FILE *out, const NodeLog &node, const LogEntry &entry, int64_t origin);
+
+// Every entry of every aligned node, in time order
+void printTimeline(FILE *out, const NodeLogs &nodes);
+
+// The game history each node exported, best games first, as GameHistory ranks them
+void printHistory(FILE *out, const NodeLogs &nodes, size_t count);
+
+// Clock alignment, event counts per node, and the latency from an event to the one it causes on another
+// node. Causes older than windowUs are not matched.
+void printStatistics(FILE *out, const NodeLogs &nodes, uint32_t windowUs);
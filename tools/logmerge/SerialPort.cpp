@@ -0,0 +1,114 @@
+/*******************************************************************************
+Raw, non-blocking access to a serial port.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#include "SerialPort.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    speed_t speedOf(uint32_t baud)
+    {
+        switch (baud)
+        {
+        case 9600:
+            return B9600;
+        case 19200:
+            return B19200;
+        case 38400:
+            return B38400;
+        case 57600:
+            return B57600;
+        case 115200:
+            return B115200;
+        case 230400:
+            return B230400;
+        case 460800:
+            return B460800;
+        case 921600:
+            return B921600;
+        default:
+            return B0;
+        }
+    }
+}
+
+SerialPort::~SerialPort()
+{
+    if (descriptor >= 0)
+        close(descriptor);
+}
+
+bool SerialPort::open(const std::string &path, uint32_t baud)
+{
+    speed_t speed = speedOf(baud);
+    if (speed == B0)
+    {
+        error = "unsupported baud rate";
+        return false;
+    }
+
+    descriptor = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (descriptor < 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+
+    termios options;
+    if (tcgetattr(descriptor, &options) != 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+    cfmakeraw(&options);
+    cfsetispeed(&options, speed);
+    cfsetospeed(&options, speed);
+    options.c_cflag |= CLOCAL | CREAD;
+    options.c_cflag &= ~CRTSCTS;
+    if (tcsetattr(descriptor, TCSANOW, &options) != 0)
+    {
+        error = strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+long SerialPort::read(uint8_t *buffer, size_t size)
+{
+    ssize_t len = ::read(descriptor, buffer, size);
+    if (len < 0)
+        return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    return len;
+}
+
+bool SerialPort::write(const uint8_t *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t len = ::write(descriptor, data, size);
+        if (len < 0 && errno != EAGAIN && errno != EINTR)
+            return false;
+        if (len > 0)
+        {
+            data += len;
+            size -= len;
+        }
+    }
+    return tcdrain(descriptor) == 0;
+}
+
+uint64_t hostMicros()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
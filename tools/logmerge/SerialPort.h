@@ -0,0 +1,42 @@
+/*******************************************************************************
+Raw, non-blocking access to a serial port.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class SerialPort
+{
+public:
+    SerialPort() = default;
+    SerialPort(const SerialPort &) = delete;
+    SerialPort &operator=(const SerialPort &) = delete;
+    ~SerialPort();
+
+    // Open the device in raw 8N1 mode. Returns false and sets error on failure.
+    bool open(const std::string &path, uint32_t baud);
+
+    // Read what is available without blocking. Returns 0 when nothing is, -1 on error.
+    long read(uint8_t *buffer, size_t size);
+
+    // Send a few bytes, such as a command to the node. Returns false if they could not all be written.
+    bool write(const uint8_t *data, size_t size);
+
+    int fd() const
+    {
+        return descriptor;
+    }
+
+    std::string error;
+
+private:
+    int descriptor = -1;
+};
+
+// Host microseconds from a monotonic clock
+uint64_t hostMicros();
@@ -0,0 +1,327 @@
+/*******************************************************************************
+logmerge: reads the serial logs of the manager and the remote, live from
+their serial ports or from captures, decodes the BinLog frames, aligns both
+clocks on the host's and prints a merged timeline with latency statistics.
+
+Made by Valérian Grégoire--Bégranger -- 2025
+*******************************************************************************/
+
+#include "NodeLog.h"
+#include "Report.h"
+#include "SerialPort.h"
+
+#include <BinLogCapture.h>
+#include <InputCapture.h>
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        uint32_t baud = 115200;
+        std::string captureDir;
+        bool follow = false;
+        bool timeline = true;
+        uint32_t durationS = 0; // 0 reads the serial ports until interrupted
+        uint32_t windowMs = 5000;
+        std::string exportHistory; // Node asked for its game history
+        std::vector<std::string> dumpInputs; // Nodes asked for their recorded inputs
+        std::string inputsDir;
+        std::vector<std::pair<std::string, std::string>> sources; // Node name and path
+    };
+
+    // Byte making the manager export its game history, and how many of its games to rank
+    const char historyCommand = 'H';
+    const size_t historyRanks = 10;
+
+    // Byte making a node dump the inputs it recorded since its boot
+    const char dumpInputsCommand = 'R';
+
+    volatile sig_atomic_t interrupted = 0;
+
+    void onInterrupt(int)
+    {
+        interrupted = 1;
+    }
+
+    void usage(const char *program)
+    {
+        fprintf(stderr, "Usage: %s [options] NAME=SOURCE...\n"
+                        "  SOURCE is a serial device, read until Ctrl-C, or a capture file. For example:\n"
+                        "    %s manager=/dev/ttyUSB0 remote=/dev/ttyUSB1\n"
+                        "  --baud N          Serial port speed (default 115200)\n"
+                        "  --capture DIR     Save what the serial ports send to DIR/NAME.cap\n"
+                        "  --follow          Print the serial ports' entries as they arrive\n"
+                        "  --duration S      Stop reading the serial ports after S seconds\n"
+                        "  --window MS       Longest latency matched between two events (default 5000)\n"
+                        "  --export-history NAME  Ask the manager on serial port NAME for its game history\n"
+                        "  --dump-inputs NAME     Ask the node on serial port NAME for its recorded inputs (repeatable)\n"
+                        "  --save-inputs DIR      Save the inputs the nodes dumped to DIR/NAME.inputs, for the\n"
+                        "                         simulator's --replay\n"
+                        "  --no-timeline     Only print the statistics\n",
+                program, program);
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const char *arg = argv[i];
+            const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+            if (!strcmp(arg, "--follow"))
+            {
+                options.follow = true;
+                continue;
+            }
+            if (!strcmp(arg, "--no-timeline"))
+            {
+                options.timeline = false;
+                continue;
+            }
+            if (arg[0] != '-')
+            {
+                const char *equal = strchr(arg, '=');
+                if (!equal || equal == arg || !equal[1])
+                    return false;
+                options.sources.emplace_back(std::string(arg, equal), equal + 1);
+                continue;
+            }
+            if (!value)
+                return false;
+
+            if (!strcmp(arg, "--baud"))
+                options.baud = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--capture"))
+                options.captureDir = value;
+            else if (!strcmp(arg, "--duration"))
+                options.durationS = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--window"))
+                options.windowMs = strtoul(value, nullptr, 10);
+            else if (!strcmp(arg, "--export-history"))
+                options.exportHistory = value;
+            else if (!strcmp(arg, "--dump-inputs"))
+                options.dumpInputs.push_back(value);
+            else if (!strcmp(arg, "--save-inputs"))
+                options.inputsDir = value;
+            else
+                return false;
+            ++i;
+        }
+        return !options.sources.empty();
+    }
+
+    bool isSerialPort(const std::string &path)
+    {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 && S_ISCHR(info.st_mode);
+    }
+
+    bool readCapture(const std::string &path, NodeLog &node)
+    {
+        CaptureReader reader;
+        if (!reader.open(path.c_str()))
+        {
+            fprintf(stderr, "%s: not a capture file\n", path.c_str());
+            return false;
+        }
+        uint64_t hostTime;
+        std::vector<uint8_t> data;
+        while (reader.next(hostTime, data))
+        {
+            node.feed(hostTime, data.data(), data.size());
+        }
+        return true;
+    }
+
+    struct Port
+    {
+        NodeLog *node;
+        SerialPort serial;
+        CaptureWriter capture;
+    };
+
+    // Send a command byte to the node on serial port name. What it sends back is read with the rest.
+    bool sendCommand(std::vector<std::unique_ptr<Port>> &ports, const std::string &name, char command)
+    {
+        auto port = std::find_if(ports.begin(), ports.end(), [&name](const std::unique_ptr<Port> &port)
+                                 { return port->node->name == name; });
+        if (port == ports.end())
+        {
+            fprintf(stderr, "%s: not a serial port\n", name.c_str());
+            return false;
+        }
+        const uint8_t byte = command;
+        if (!(*port)->serial.write(&byte, 1))
+        {
+            fprintf(stderr, "%s: cannot send the '%c' command\n", name.c_str(), command);
+            return false;
+        }
+        return true;
+    }
+
+    // Put together the last input dump of each node, from the boot it was made in, and save it
+    bool saveInputs(const NodeLogs &nodes, const std::string &dir)
+    {
+        bool saved = true;
+        for (const std::unique_ptr<NodeLog> &node : nodes)
+        {
+            auto end = std::find_if(node->entries.rbegin(), node->entries.rend(), [](const LogEntry &entry)
+                                    { return entry.isRecord && entry.record.id == LOG_INPUT_END; });
+            if (end == node->entries.rend())
+                continue;
+
+            InputDumpAssembler assembler;
+            for (const LogEntry &entry : node->entries)
+            {
+                if (entry.isRecord && entry.segment == end->segment)
+                    assembler.add(entry.record);
+            }
+            std::vector<uint8_t> recording = assembler.recording();
+            std::string path = dir + "/" + node->name + ".inputs";
+            if (assembler.missingChunks() > 0)
+            {
+                fprintf(stderr, "%s: %zu chunks of the inputs missing, not saved\n", node->name.c_str(), assembler.missingChunks());
+                saved = false;
+            }
+            else if (!writeInputs(path.c_str(), recording))
+            {
+                fprintf(stderr, "%s: cannot write the inputs\n", path.c_str());
+                saved = false;
+            }
+            else
+            {
+                printf("Inputs of %s: %zu bytes saved to %s", node->name.c_str(), recording.size(), path.c_str());
+                if (assembler.droppedInputs() > 0)
+                    printf(", ending at the first of %u inputs the node had no room for", assembler.droppedInputs());
+                printf("\n");
+            }
+        }
+        return saved;
+    }
+
+    // Read every serial port until interrupted or out of time. Bytes are taken as soon as poll()
+    // reports them and only decoded in memory, so the kernel buffers never fill up at full baud.
+    bool readSerialPorts(std::vector<std::unique_ptr<Port>> &ports, const Options &options)
+    {
+        std::vector<pollfd> fds;
+        for (const std::unique_ptr<Port> &port : ports)
+        {
+            fds.push_back({port->serial.fd(), POLLIN, 0});
+        }
+
+        signal(SIGINT, onInterrupt);
+        signal(SIGTERM, onInterrupt);
+        uint64_t start = hostMicros();
+        uint64_t end = options.durationS ? start + (uint64_t)options.durationS * 1000000 : UINT64_MAX;
+        uint8_t buffer[4096];
+        while (!interrupted && hostMicros() < end)
+        {
+            if (poll(fds.data(), fds.size(), 100) < 0)
+                continue;
+
+            for (size_t i = 0; i < ports.size(); ++i)
+            {
+                if (!(fds[i].revents & (POLLIN | POLLERR | POLLHUP)))
+                    continue;
+
+                Port &port = *ports[i];
+                long len;
+                while ((len = port.serial.read(buffer, sizeof(buffer))) > 0)
+                {
+                    uint64_t now = hostMicros();
+                    port.capture.write(now, buffer, len);
+                    size_t added = port.node->feed(now, buffer, len);
+                    if (options.follow)
+                    {
+                        for (size_t j = port.node->entries.size() - added; j < port.node->entries.size(); ++j)
+                        {
+                            printEntry(stdout, *port.node, port.node->entries[j], start);
+                        }
+                        fflush(stdout);
+                    }
+                }
+                if (len < 0)
+                {
+                    fprintf(stderr, "%s: serial port closed\n", port.node->name.c_str());
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    NodeLogs nodes;
+    std::vector<std::unique_ptr<Port>> ports;
+    for (const auto &source : options.sources)
+    {
+        nodes.emplace_back(new NodeLog(source.first));
+        NodeLog &node = *nodes.back();
+        if (!isSerialPort(source.second))
+        {
+            if (!readCapture(source.second, node))
+                return EXIT_FAILURE;
+            continue;
+        }
+
+        ports.emplace_back(new Port);
+        Port &port = *ports.back();
+        port.node = &node;
+        if (!port.serial.open(source.second, options.baud))
+        {
+            fprintf(stderr, "%s: %s\n", source.second.c_str(), port.serial.error.c_str());
+            return EXIT_FAILURE;
+        }
+        if (!options.captureDir.empty())
+        {
+            std::string path = options.captureDir + "/" + source.first + ".cap";
+            if (!port.capture.open(path.c_str()))
+            {
+                fprintf(stderr, "%s: cannot write the capture\n", path.c_str());
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    // The nodes send their history and inputs as log records, which are read with the rest
+    if (!options.exportHistory.empty() && !sendCommand(ports, options.exportHistory, historyCommand))
+        return EXIT_FAILURE;
+    for (const std::string &name : options.dumpInputs)
+    {
+        if (!sendCommand(ports, name, dumpInputsCommand))
+            return EXIT_FAILURE;
+    }
+
+    bool complete = ports.empty() || readSerialPorts(ports, options);
+
+    for (const std::unique_ptr<NodeLog> &node : nodes)
+    {
+        node->align();
+    }
+    if (options.timeline)
+        printTimeline(stdout, nodes);
+    printStatistics(stdout, nodes, options.windowMs * 1000);
+    printHistory(stdout, nodes, historyRanks);
+    if (!options.inputsDir.empty() && !saveInputs(nodes, options.inputsDir))
+        complete = false;
+    return complete ? EXIT_SUCCESS : EXIT_FAILURE;
+}